@@ -8,7 +8,10 @@ GizmoGardenPixels libraries for more information.
 The modifications are trivial and fully backwards compatible with the
 Adafruit version 1.0.3. The portion of Adafruit_NeoPixel::show that runs
 with interrupts off is broken out into a separate member function. Show
-can be used as before.
+can be used as before. The separate function can send a buffer other
+than pixels, so that GizmoGardenPixels can apply brightness to a copy
+without losing the colors, and the pixels can be kept in a buffer that
+the caller provides instead of one from malloc.
 
 The library and source file names have been changed so as to avoid
 comfusion with the Adafruit originals. The class name is unchanged
@@ -60,7 +63,7 @@ purpose.
 
 // Constructor when length, pin and type are known at compile-time:
 Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, uint8_t p, neoPixelType t) :
-  brightness(0), pixels(NULL), endTime(0), begun(false)
+  brightness(0), pixels(NULL), endTime(0), begun(false), ownPixels(true)
 {
   updateType(t);
   updateLength(n);
@@ -73,7 +76,7 @@ Adafruit_NeoPixel::Adafruit_NeoPixel(uint16_t n, uint8_t p, neoPixelType t) :
 // command.  If using this constructor, MUST follow up with updateType(),
 // updateLength(), etc. to establish the strand type, length and pin number!
 Adafruit_NeoPixel::Adafruit_NeoPixel() :
-  pin(-1), brightness(0), pixels(NULL), endTime(0), begun(false),
+  pin(-1), brightness(0), pixels(NULL), endTime(0), begun(false), ownPixels(true),
   numLEDs(0), numBytes(0), rOffset(1), gOffset(0), bOffset(2), wOffset(1)
 #ifdef NEO_KHZ400
   , is800KHz(true)
@@ -82,7 +85,7 @@ Adafruit_NeoPixel::Adafruit_NeoPixel() :
 }
 
 Adafruit_NeoPixel::~Adafruit_NeoPixel() {
-  if(pixels)   free(pixels);
+  if(pixels && ownPixels) free(pixels);
   if(pin >= 0) pinMode(pin, INPUT);
 }
 
@@ -95,7 +98,8 @@ void Adafruit_NeoPixel::begin(void) {
 }
 
 void Adafruit_NeoPixel::updateLength(uint16_t n) {
-  if(pixels) free(pixels); // Free existing data (if any)
+  if(pixels && ownPixels) free(pixels); // Free existing data (if any)
+  ownPixels = true;
 
   // Allocate new data -- note: ALL PIXELS ARE CLEARED
   numBytes = n * ((wOffset == rOffset) ? 3 : 4);
@@ -107,6 +111,18 @@ void Adafruit_NeoPixel::updateLength(uint16_t n) {
   }
 }
 
+// Gizmo Garden addition: use a buffer that the caller owns, such as a
+// static array, instead of allocating one. It must hold n pixels of the
+// current type. ALL PIXELS ARE CLEARED.
+void Adafruit_NeoPixel::setBuffer(uint8_t *buffer, uint16_t n) {
+  if(pixels && ownPixels) free(pixels);
+  ownPixels = false;
+  pixels    = buffer;
+  numLEDs   = n;
+  numBytes  = n * ((wOffset == rOffset) ? 3 : 4);
+  memset(pixels, 0, numBytes);
+}
+
 void Adafruit_NeoPixel::updateType(neoPixelType t) {
   boolean oldThreeBytesPerPixel = (wOffset == rOffset); // false if RGBW
 
@@ -153,8 +169,11 @@ void Adafruit_NeoPixel::show(void)
   endTime = micros(); // Save EOD time for latch on next call
 }
 
-void Adafruit_NeoPixel::showInterrupt(void)
+void Adafruit_NeoPixel::showInterrupt(uint8_t *data)
 {
+  // Gizmo Garden addition: send data instead of pixels if given. It must
+  // hold numBytes bytes in the same order as pixels.
+  uint8_t *source = data ? data : pixels;
 
   // In order to make this code runtime-configurable to work with any pin,
   // SBI/CBI instructions are eschewed in favor of full PORT writes via the
@@ -172,7 +191,7 @@ void Adafruit_NeoPixel::showInterrupt(void)
   volatile uint16_t
     i   = numBytes; // Loop counter
   volatile uint8_t
-   *ptr = pixels,   // Pointer to next byte
+   *ptr = source,   // Pointer to next byte
     b   = *ptr++,   // Current byte value
     hi,             // PORT w/output bit set high
     lo;             // PORT w/output bit set low
@@ -760,7 +779,7 @@ void Adafruit_NeoPixel::showInterrupt(void)
 #define CYCLES_400_T1H  (F_CPU /  833333)
 #define CYCLES_400      (F_CPU /  400000)
 
-  uint8_t          *p   = pixels,
+  uint8_t          *p   = source,
                    *end = p + numBytes, pix, mask;
   volatile uint8_t *set = portSetRegister(pin),
                    *clr = portClearRegister(pin);
@@ -812,7 +831,7 @@ void Adafruit_NeoPixel::showInterrupt(void)
 #elif defined(__MKL26Z64__) // Teensy-LC
 
 #if F_CPU == 48000000
-  uint8_t          *p   = pixels,
+  uint8_t          *p   = source,
 		   pix, count, dly,
                    bitmask = digitalPinToBitMask(pin);
   volatile uint8_t *reg = portSetRegister(pin);
@@ -905,7 +924,7 @@ void Adafruit_NeoPixel::showInterrupt(void)
 
   portNum =  g_APinDescription[pin].ulPort;
   pinMask =  1ul << g_APinDescription[pin].ulPin;
-  ptr     =  pixels;
+  ptr     =  source;
   end     =  ptr + numBytes;
   p       = *ptr++;
   bitMask =  0x80;
@@ -1000,7 +1019,7 @@ void Adafruit_NeoPixel::showInterrupt(void)
   portClear = &(port->PIO_CODR);            // starting timer to minimize
   timeValue = &(TC1->TC_CHANNEL[0].TC_CV);  // the initial 'while'.
   timeReset = &(TC1->TC_CHANNEL[0].TC_CCR);
-  p         =  pixels;
+  p         =  source;
   end       =  p + numBytes;
   pix       = *p++;
   mask      = 0x80;
@@ -1045,7 +1064,7 @@ void Adafruit_NeoPixel::showInterrupt(void)
 // ESP8266 ----------------------------------------------------------------
 
   // ESP8266 show() is external to enforce ICACHE_RAM_ATTR execution
-  espShow(pin, pixels, numBytes, is800KHz);
+  espShow(pin, source, numBytes, is800KHz);
 
 #endif // ESP8266
 
@@ -176,8 +176,20 @@ class Adafruit_NeoPixel {
   inline bool
     canShow(void) { return (micros() - endTime) >= 50L; }
 
-  // Gizmo Garden addition
-  void showInterrupt();
+  // Gizmo Garden additions
+  void showInterrupt(uint8_t *data = NULL);
+  void setBuffer(uint8_t *buffer, uint16_t n);
+  uint16_t getNumBytes(void) const { return numBytes; }
+  uint8_t getColorOrder(void) const { // NEO_GRB etc., without NEO_KHZ400
+    return (wOffset << 6) | (rOffset << 4) | (gOffset << 2) | bOffset;
+  }
+  uint16_t getShowTime(void) const { // Microseconds in showInterrupt
+#ifdef NEO_KHZ400
+    return numBytes * (is800KHz ? 10 : 20);
+#else
+    return numBytes * 10;
+#endif
+  }
 
  private:
 
@@ -185,7 +197,8 @@ class Adafruit_NeoPixel {
 #ifdef NEO_KHZ400  // If 400 KHz NeoPixel support enabled...
     is800KHz,      // ...true if 800 KHz pixels
 #endif
-    begun;         // true if begin() previously called
+    begun,         // true if begin() previously called
+    ownPixels;     // false if pixels came from setBuffer
   uint16_t
     numLEDs,       // Number of RGB LEDs in strip
     numBytes;      // Size of 'pixels' buffer below (3 or 4 bytes/pixel)
@@ -15,7 +15,9 @@ a particular purpose.
 // *                                *
 // **********************************
 
-uint16_t getMusicTime(GizmoGardenText& notes, int beatLength)
+// Works for strings in flash or RAM
+template<class P>
+uint8_t musicTicks(P& notes)
 {
   char c;
   do
@@ -31,25 +33,169 @@ uint16_t getMusicTime(GizmoGardenText& notes, int beatLength)
       if (i < 5)
       {
         // Power of 2 notes
-        uint16_t t = 2 << i;
+        uint8_t t = (MusicTicksPerBeat / 4) << i;
         c = *notes;
         if (c == '.')
         {
-          t += 1 << i;
+          t += t >> 1;
           ++notes;
         }
       
-        return t * beatLength >> 3;
+        return t;
       }
       else
         // "T" is a triplet note
-        return (beatLength + 1) / 3;
+        return MusicTicksPerBeat / 3;
     }
 
   --notes;
   return 0;
 }
 
+uint8_t getMusicTicks(GizmoGardenText& notes)
+{
+  return musicTicks(notes);
+}
+
+uint8_t getMusicTicks(const char*& notes)
+{
+  return musicTicks(notes);
+}
+
+uint16_t getMusicTime(GizmoGardenText& notes, int beatLength)
+{
+  return musicTicksToTime(getMusicTicks(notes), beatLength);
+}
+
+void GizmoGardenRepeats::reset(GizmoGardenText durations)
+{
+  start = durations;
+  depth = 0;
+  next = current = 0;
+}
+
+// Search from the start of the string for the definition of the
+// specified segment. If found, leave s just past the label and set
+// next to the written index of the first note of the segment. Only
+// the duration letters are upper case, so they are easy to count.
+bool GizmoGardenRepeats::findSegment(GizmoGardenText& s, char label)
+{
+  uint16_t n = 0;
+  GizmoGardenText p = start;
+  while (true)
+  {
+    char c = *p++;
+    if (c == 0)
+      return false;
+
+    if (c == '{' && *p == label)
+    {
+      s = p + 1;
+      next = n;
+      return true;
+    }
+
+    if (c >= 'A' && c <= 'Z')
+      ++n;
+  }
+}
+
+// Process any markers and spaces in front of the next note. Return false
+// on an error, leaving notes pointing at the offending marker.
+bool GizmoGardenRepeats::skipMarkers(GizmoGardenText& notes)
+{
+  while (true)
+  {
+    switch (*notes)
+    {
+    case ' ':
+      ++notes;
+      break;
+
+    case '(':
+      if (depth == Depth)
+        return false;
+      ++notes;
+      stack[depth].resume = notes;
+      stack[depth].note = next;
+      stack[depth].passes = 0;
+      ++depth;
+      break;
+
+    case ')':
+    {
+      if (depth == 0 || stack[depth - 1].passes == CallFrame)
+        return false;
+
+      Frame& f = stack[depth - 1];
+      GizmoGardenText p = notes + 1;
+      uint8_t n = *p - '0';
+      if (n >= 1 && n <= 9)
+        ++p;
+      else
+        n = 2;
+
+      if (++f.passes < n)
+      {
+        notes = f.resume;
+        next = f.note;
+      }
+      else
+      {
+        notes = p;
+        --depth;
+      }
+      break;
+    }
+
+    case '{':
+      // A segment definition reached in line just plays
+      if (notes[1] == 0)
+        return false;
+      notes = notes + 2;
+      break;
+
+    case '}':
+      ++notes;
+      if (depth > 0 && stack[depth - 1].passes == CallFrame)
+      {
+        --depth;
+        notes = stack[depth].resume;
+        next = stack[depth].note;
+      }
+      break;
+
+    case '*':
+      if (depth == Depth)
+        return false;
+      stack[depth].resume = notes + 2;
+      stack[depth].note = next;
+      stack[depth].passes = CallFrame;
+      if (!findSegment(notes, notes[1]))
+        return false;
+      ++depth;
+      break;
+
+    default:
+      return true;
+    }
+  }
+}
+
+uint8_t getMusicTicks(GizmoGardenText& notes, GizmoGardenRepeats& repeats)
+{
+  uint8_t t = repeats.skipMarkers(notes) ? getMusicTicks(notes) : 0;
+  repeats.current = repeats.next;
+  if (t != 0)
+    ++repeats.next;
+  return t;
+}
+
+uint16_t getMusicTime(GizmoGardenText& notes, int beatLength, GizmoGardenRepeats& repeats)
+{
+  return musicTicksToTime(getMusicTicks(notes, repeats), beatLength);
+}
+
 // ************************
 // *                      *
 // *  Formatted Printing  *
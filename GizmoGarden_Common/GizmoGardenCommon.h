@@ -223,7 +223,8 @@ bool objectsEqual(const T& a, const T& b)
 
 // Return time in milliseconds for the next note in the specified
 // string, and update the string pointer. beatlength is the time
-// for a quarter note. Times are specified by a character:
+// for a quarter note, and the time is computed from getMusicTicks
+// below. Times are specified by a character:
 //    S   sixteenth
 //    E   eighth
 //    Q   quarter
@@ -238,6 +239,84 @@ bool objectsEqual(const T& a, const T& b)
 // is reached.
 uint16_t getMusicTime(GizmoGardenText&, int beatLength);
 
+// Same as getMusicTime, but return the time in ticks, where there are
+// MusicTicksPerBeat ticks in a quarter note. Every note time is an
+// exact number of ticks, so that players following a common beat
+// clock (see GizmoGardenMultitasking.h) never accumulate rounding
+// error.
+enum { MusicTicksPerBeat = 24 };
+uint8_t getMusicTicks(GizmoGardenText&);
+
+// Same, for a string in RAM, such as one received over a stream.
+uint8_t getMusicTicks(const char*&);
+
+// Convert music ticks to milliseconds for the specified beat length.
+inline uint16_t musicTicksToTime(uint8_t ticks, int beatLength)
+{
+  return (uint32_t)ticks * beatLength / MusicTicksPerBeat;
+}
+
+// Songs and dances are mostly repeated phrases. So that a phrase need
+// only be stored once, the versions of getMusicTime and getMusicTicks
+// that take a GizmoGardenRepeats also understand these markers in the
+// string:
+//    (  ...  )n   Play the enclosed notes n times, where n is a single
+//                 digit 1-9. If n is omitted the notes are played twice.
+//    {x  ...  }   Define segment x, where x is a lower case letter. The
+//                 segment plays where it is defined.
+//    *x           Play segment x again, then continue after the *x.
+//
+// For example, "(Q Q E.S Q)3 {c H H} E E Q *c" plays the first phrase
+// three times and the "c" segment twice. Repeats and segment calls can
+// be nested up to GizmoGardenRepeats::Depth deep, but one segment cannot
+// be defined inside another. Spaces are ignored as before.
+//
+// Markers appear only in the duration string. The pitches, dance moves,
+// or gesture angles that go with the durations are stored once, one for
+// each note in the order written, and repeats replay them along with the
+// durations. After each call to getMusicTime, noteIndex() gives the
+// position, in written order, of the note whose time was returned, or
+// the number of written notes if the end of the string was reached.
+//
+// Unbalanced markers, unknown segments, or nesting too deep are
+// treated as unrecognized text, and getMusicTime returns 0.
+
+class GizmoGardenRepeats
+{
+public:
+  enum { Depth = 4 };
+
+  // Call this with the start of the duration string before the first
+  // call to getMusicTime.
+  void reset(GizmoGardenText durations);
+
+  uint16_t noteIndex() const { return current; }
+
+private:
+  friend uint8_t getMusicTicks(GizmoGardenText&, GizmoGardenRepeats&);
+
+  struct Frame
+  {
+    GizmoGardenText resume;   // Where to go back to
+    uint16_t note;            // Written note index at resume
+    uint8_t passes;           // Passes completed, or CallFrame
+  };
+
+  enum { CallFrame = 0xFF };
+
+  GizmoGardenText start;
+  Frame stack[Depth];
+  uint8_t depth;
+  uint16_t next;              // Written index of the next note
+  uint16_t current;
+
+  bool skipMarkers(GizmoGardenText&);
+  bool findSegment(GizmoGardenText&, char label);
+};
+
+uint16_t getMusicTime(GizmoGardenText&, int beatLength, GizmoGardenRepeats&);
+uint8_t getMusicTicks(GizmoGardenText&, GizmoGardenRepeats&);
+
 // **********************
 // *                    *
 // *  Smoothing Filter  *
@@ -167,8 +167,10 @@ void GizmoGardenDriver::customStop()
 void GizmoGardenDriver::spin()
 {
   setFullSpeed(100);
+  GizmoGardenServo::beginUpdate();
   wheels[0]->setSpeed( 100);
   wheels[1]->setSpeed(-100);
+  GizmoGardenServo::endUpdate();
   spinMode = 1;
 }
 
@@ -209,8 +211,10 @@ void GizmoGardenDriver::myTurn()
       turn = (kp * diff) >> 6;
     }
    
+    GizmoGardenServo::beginUpdate();
     wheels[0]->setSpeed(speed - max(turn, 0));
     wheels[1]->setSpeed(speed + min(turn, 0));
+    GizmoGardenServo::endUpdate();
 
     callMe(20);
   }
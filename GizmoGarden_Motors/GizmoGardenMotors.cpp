@@ -126,6 +126,16 @@ void GizmoGardenPositioningMotor::setPosition(int pos)
   write((flipDirection ? -pos : pos) + 90);
 }
 
+// Positions span the default pulse range over 180 degrees
+void GizmoGardenPositioningMotor::setMotion(int speed, int acceleration)
+{
+  const long usPerHalfCircle = MaxPulseTime - MinPulseTime;
+  speed = max(speed, 0);
+  acceleration = max(acceleration, 0);
+  GizmoGardenServo::setMotion((uint16_t)min(speed * usPerHalfCircle / 180, 65535L),
+                              (uint16_t)min(acceleration * usPerHalfCircle / 180, 65535L));
+}
+
 // ************
 // *          *
 // *  Dancer  *
@@ -136,10 +146,16 @@ GizmoGardenDancer::GizmoGardenDancer
   (GizmoGardenRotatingMotor& leftWheel, GizmoGardenRotatingMotor& rightWheel,
    uint16_t baseTime)
   : leftWheel(leftWheel), rightWheel(rightWheel), baseTime(baseTime),
-    GizmoGardenTask(false)
+    clock(0), GizmoGardenTask(false)
 {
 }
 
+void GizmoGardenDancer::setBeatClock(GizmoGardenBeatClock* clock)
+{
+  this->clock = clock;
+  position = GizmoGardenBeatClock::NotJoined;
+}
+
 #ifdef TASK_MONITOR
 GizmoGardenText GizmoGardenDancer::name() const
 {
@@ -147,23 +163,40 @@ GizmoGardenText GizmoGardenDancer::name() const
 }
 #endif
 
-void GizmoGardenDancer::dance(GizmoGardenDanceMove* dm, GizmoGardenText durations)
+void GizmoGardenDancer::dance(GizmoGardenDanceMove* moves, GizmoGardenText durations)
 {
   stop();
-  this->dm = dm;
+  this->moves = moves;
   this->durations = durations;
+  repeats.reset(durations);
+  position = GizmoGardenBeatClock::NotJoined;
   start();
 }
 
 void GizmoGardenDancer::myTurn()
 {
+  if (clock != 0)
+  {
+    uint32_t t = clock->join(position);
+    if (t != 0)
+    {
+      callMeAt(t);
+      return;
+    }
+  }
+
+  uint8_t ticks = getMusicTicks(durations, repeats);
+  GizmoGardenDanceMove* dm = moves + repeats.noteIndex();
+  GizmoGardenServo::beginUpdate();
   leftWheel .setSpeed(dm->leftSpeed );
   rightWheel.setSpeed(dm->rightSpeed);
-  uint16_t time = getMusicTime(durations, baseTime);
-  if (time > 0)
+  GizmoGardenServo::endUpdate();
+  if (ticks > 0)
   {
-    ++dm;
-    callMe(time);
+    if (clock != 0)
+      callMeAt(clock->timeOf(position += ticks));
+    else
+      callMe(musicTicksToTime(ticks, baseTime));
   }
 }
 
@@ -175,9 +208,15 @@ void GizmoGardenDancer::myTurn()
 
 GizmoGardenGestures::GizmoGardenGestures
   (GizmoGardenPositioningMotor& motor, uint16_t baseTime)
-  : motor(motor), baseTime(baseTime), GizmoGardenTask(false)
+  : motor(motor), baseTime(baseTime), clock(0), GizmoGardenTask(false)
 {}
 
+void GizmoGardenGestures::setBeatClock(GizmoGardenBeatClock* clock)
+{
+  this->clock = clock;
+  position = GizmoGardenBeatClock::NotJoined;
+}
+
 #ifdef TASK_MONITOR
 GizmoGardenText GizmoGardenGestures::name() const
 {
@@ -191,15 +230,32 @@ void GizmoGardenGestures::play(const GizmoGardenGestureAngle* angles,
   stop();
   this->angles = angles;
   this->times = times;
+  repeats.reset(times);
+  position = GizmoGardenBeatClock::NotJoined;
   start();
 }
 
 void GizmoGardenGestures::myTurn()
 {
-  int angle = *angles++;
+  if (clock != 0)
+  {
+    uint32_t t = clock->join(position);
+    if (t != 0)
+    {
+      callMeAt(t);
+      return;
+    }
+  }
+
+  uint8_t ticks = getMusicTicks(times, repeats);
+  int angle = angles[repeats.noteIndex()];
   if (angle != GestureKeep)
     motor.setPosition(angle);
-  uint16_t time = getMusicTime(times, baseTime);
-  if (time != 0)
-    callMe(time);
+  if (ticks != 0)
+  {
+    if (clock != 0)
+      callMeAt(clock->timeOf(position += ticks));
+    else
+      callMe(musicTicksToTime(ticks, baseTime));
+  }
 }
@@ -115,6 +115,20 @@ public:
   // the extra range of position is because the offset might not be 0.
   int getPosition() const { return position; }
   void setPosition(int);
+
+  // Limit speed in degrees per second and acceleration in degrees per
+  // second per second, so that setPosition moves smoothly instead of as
+  // fast as the servo can go. An acceleration of 0 means no limit, and a
+  // speed of 0 turns the limits off. See motion profiles in
+  // GizmoGardenServo.h. isMoving tells if the motor hasn't gotten to the
+  // position yet.
+  void setMotion(int speed, int acceleration = 0);
+  bool isMoving() { return GizmoGardenServo::isMoving(); }
+
+  // Stop pulsing the servo after the specified number of frames (about
+  // 20 ms each) at the same position, to save power. The next setPosition
+  // to a different position starts it again. See idle servos in GizmoGardenServo.h.
+  void setIdleFrames(uint8_t frames) { GizmoGardenServo::setIdleFrames(frames); }
 };
 
 // ************
@@ -134,6 +148,14 @@ public:
 // there are notes in the durations string. The final move is executed
 // to conclude the dance, which can be RestMotion to stop or anything
 // else to keep moving.
+//
+// The durations string can use the repeat and segment markers described
+// in GizmoGardenCommon.h. The moves are written once, one for each note
+// in the durations string as written, and are replayed with the repeats.
+//
+// Both wheels change speed in the same servo frame, using the batched
+// updates of GizmoGardenServo, so a robot told to go straight doesn't
+// wiggle.
 
 struct GizmoGardenDanceMove
 {
@@ -159,14 +181,22 @@ public:
 
   void dance(GizmoGardenDanceMove*, GizmoGardenText durations);
 
+  // Follow the specified beat clock instead of baseTime, or stop
+  // following if 0. See GizmoGardenMultitasking.h.
+  void setBeatClock(GizmoGardenBeatClock* clock);
+
 private:
   GizmoGardenRotatingMotor& leftWheel;
   GizmoGardenRotatingMotor& rightWheel;
 
   uint16_t baseTime;
 
-  GizmoGardenDanceMove* dm;
+  GizmoGardenDanceMove* moves;
   GizmoGardenText durations;
+  GizmoGardenRepeats repeats;
+
+  GizmoGardenBeatClock* clock;
+  uint32_t position;
 
   virtual void myTurn();
 
@@ -188,7 +218,8 @@ private:
 // using GizmoGardenText strings, formatted for getMusicTime and
 // documented in GizmoGardenCommon.h. If an angle is given the
 // value GestureKeep, the previous position is kept for the current
-// note time.
+// note time. As with GizmoGardenDancer, the times can use repeat and
+// segment markers, with one angle for each note as written.
 
 enum GizmoGardenDanceCodes
 {
@@ -204,6 +235,10 @@ public:
 
   void play(const GizmoGardenGestureAngle* angles, GizmoGardenText times);
 
+  // Follow the specified beat clock instead of baseTime, or stop
+  // following if 0. See GizmoGardenMultitasking.h.
+  void setBeatClock(GizmoGardenBeatClock* clock);
+
 private:
   GizmoGardenPositioningMotor& motor;
 
@@ -211,6 +246,10 @@ private:
 
   const GizmoGardenGestureAngle* angles;
   GizmoGardenText times;
+  GizmoGardenRepeats repeats;
+
+  GizmoGardenBeatClock* clock;
+  uint32_t position;
 
   virtual void myTurn();
 
@@ -150,6 +150,12 @@ void GizmoGardenTask::callMeFromNow(uint16_t ms)
   running = true;
 }
 
+void GizmoGardenTask::callMeAt(uint32_t ms)
+{
+  scheduleMe(ms);
+  running = true;
+}
+
 void GizmoGardenTask::start(uint16_t ms)
 {
   stop();
@@ -215,6 +221,58 @@ void GizmoGardenTask::run()
   }
 }
 
+// **********************
+// *                    *
+// *  Shared Beat Clock  *
+// *                    *
+// **********************
+
+GizmoGardenBeatClock::GizmoGardenBeatClock(int beatLength)
+  : originTime(0), originPosition(0), beatLength(beatLength)
+{
+}
+
+void GizmoGardenBeatClock::start()
+{
+  originTime = millis();
+  originPosition = 0;
+}
+
+// Move the origin to the present before changing the beat length, so that
+// the timeline is continuous across the change.
+void GizmoGardenBeatClock::setBeatLength(int bl)
+{
+  originPosition = positionAt(millis());
+  originTime = timeOf(originPosition);
+  beatLength = bl;
+}
+
+uint32_t GizmoGardenBeatClock::timeOf(uint32_t position) const
+{
+  return originTime + (int32_t)(position - originPosition) * beatLength / MusicTicksPerBeat;
+}
+
+uint32_t GizmoGardenBeatClock::positionAt(uint32_t ms) const
+{
+  return originPosition + (int32_t)(ms - originTime) * MusicTicksPerBeat / beatLength;
+}
+
+uint32_t GizmoGardenBeatClock::nearestBeat() const
+{
+  uint32_t p = positionAt(millis()) + MusicTicksPerBeat / 2;
+  return p - p % MusicTicksPerBeat;
+}
+
+uint32_t GizmoGardenBeatClock::join(uint32_t& position) const
+{
+  if (position != NotJoined)
+    return 0;
+
+  position = nearestBeat();
+  uint32_t t = timeOf(position);
+  return (int32_t)(t - millis()) > 0 ? t : 0;
+}
+
 extern "C"
 {
   void yield() { GizmoGardenTask::run(); }
@@ -92,6 +92,11 @@ protected:
   // after now. Use only in myTurn().
   void callMeFromNow(uint16_t ms);
 
+  // Schedule me for a call back at the specified absolute time, as
+  // returned by millis(). Unlike callMe, lateness in the current turn
+  // does not carry over to the next. Use only in myTurn().
+  void callMeAt(uint32_t ms);
+
   // Schedule me for a call back at a time when the there is nothing to
   // do for at least the specified number of milliseconds.
   void fitMeIn(uint16_t ms);
@@ -141,6 +146,58 @@ public:
   DECLARE_TASK_NAME
 };
 
+// **********************
+// *                    *
+// *  Shared Beat Clock  *
+// *                    *
+// **********************
+//
+// Tasks that keep time to music, such as GizmoGardenMusicPlayer,
+// GizmoGardenDancer, and GizmoGardenGestures, can follow a common
+// GizmoGardenBeatClock instead of their own beat length. Each follower
+// keeps its position on the clock's timeline in music ticks (see
+// getMusicTicks in GizmoGardenCommon.h) and schedules itself at the
+// ideal time of that position, so lateness never accumulates and all
+// followers stay locked together. Changing the clock's beat length
+// changes the tempo of every follower at once, without a jump in the
+// timeline.
+//
+// Call start() to set beat 0 of the timeline to the present. A follower
+// that is started joins the timeline at the beat nearest the time of its
+// first turn, waiting for that beat if necessary, so followers started
+// together, or on a beat, stay together.
+
+class GizmoGardenBeatClock
+{
+public:
+  enum { NotJoined = 0xFFFFFFFFUL };
+
+  GizmoGardenBeatClock(int beatLength);
+
+  int getBeatLength() const { return beatLength; }
+  void setBeatLength(int);
+
+  void start();
+
+  // Absolute time in milliseconds of the specified position, and the
+  // position at the specified time.
+  uint32_t timeOf(uint32_t position) const;
+  uint32_t positionAt(uint32_t ms) const;
+
+  // Position of the beat nearest to the present
+  uint32_t nearestBeat() const;
+
+  // For followers. If position is NotJoined, set it to the nearest beat.
+  // Return the time to wait for if that beat is still in the future,
+  // otherwise 0.
+  uint32_t join(uint32_t& position) const;
+
+private:
+  uint32_t originTime;
+  uint32_t originPosition;
+  int beatLength;
+};
+
 // Create a task by specifying just the body of myTurn,
 // so that 
 #define CUSTOM_START virtual void customStart();
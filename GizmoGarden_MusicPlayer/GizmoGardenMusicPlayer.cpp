@@ -11,10 +11,16 @@ a particular purpose.
 #include "GizmoGardenMusicPlayer.h"
 
 GizmoGardenMusicPlayer::GizmoGardenMusicPlayer(int beatLength, bool allowMenuStartStop)
-  : beatLength(beatLength), GizmoGardenTask(allowMenuStartStop)
+  : beatLength(beatLength), clock(0), stream(0), GizmoGardenTask(allowMenuStartStop)
 {
 }
 
+void GizmoGardenMusicPlayer::setBeatClock(GizmoGardenBeatClock* clock)
+{
+  this->clock = clock;
+  position = GizmoGardenBeatClock::NotJoined;
+}
+
 #ifdef TASK_MONITOR
 GizmoGardenText GizmoGardenMusicPlayer::name() const
 {
@@ -25,10 +31,14 @@ GizmoGardenText GizmoGardenMusicPlayer::name() const
 void GizmoGardenMusicPlayer::loadMusic(GizmoGardenText pitches,
                                        GizmoGardenText durations)
 {
-  nextPitch = pitches;
+  stream = 0;
+  this->pitches = nextPitch = pitches;
+  nextPitchNote = 0;
   nextDuration = durations;
+  repeats.reset(durations);
+  position = GizmoGardenBeatClock::NotJoined;
+  noteTime = NotStarted;
   endCode = ForcedEnd;
-  getPitchIndex();
 }
 
 void GizmoGardenMusicPlayer::play(GizmoGardenText pitches,
@@ -38,57 +48,130 @@ void GizmoGardenMusicPlayer::play(GizmoGardenText pitches,
   start();
 }
 
+void GizmoGardenMusicPlayer::loadMusic(GizmoGardenMusicStream& stream)
+{
+  loadMusic(F(""), F(""));
+  this->stream = &stream;
+  stream.start();
+}
+
+void GizmoGardenMusicPlayer::play(GizmoGardenMusicStream& stream)
+{
+  loadMusic(stream);
+  start();
+}
+
 enum PitchCodes
 {
   RestPitch  = -1,
   EndPitch   = -2,
-  ErrorPitch = -3
+  ErrorPitch = -3,
+  WaitPitch  = -4
 };
 
-void GizmoGardenMusicPlayer::getPitchIndex()
+// Parse one <note><octave><sharp/flat> at s and advance past it. Return
+// the pitch index, or ErrorPitch leaving s where it was. Works for strings
+// in flash or RAM.
+template<class P>
+int8_t parsePitch(P& s, int8_t& whiteIndex)
 {
   //                                A   B  C  D  E  F  G
   static const char noteTable[] = { 9, 11, 0, 2, 4, 5, 7 };
-  char c;
-  do
-  {
-    c = *nextPitch++;
-  }
-  while (c == ' ');
-
-  if (c == '-')
-  {
-    nextPitchIndex = nextWhiteIndex = RestPitch;
-    return;
-  }
-
-  uint8_t note = c - 'A';
-  uint8_t octive = *nextPitch++ - '5';
+  uint8_t note = s[0] - 'A';
+  uint8_t octive = s[1] - '5';
   if (note >= 7 || octive >= 3)
-  {
-    --nextPitch;
-    nextPitchIndex = c == 0 ? EndPitch : ErrorPitch;
-    return;
-  }
+    return ErrorPitch;
 
   note = noteTable[note];
   //note = pgm_read_byte(&noteTable[note]);
-  nextWhiteIndex = 7 * octive + ((note + 1) >> 1);
+  whiteIndex = 7 * octive + ((note + 1) >> 1);
   note += 12 * octive;
 
-  c = *nextPitch;
+  s = s + 2;
+  char c = *s;
   if (c == '#')
   {
     ++note;
-    ++nextPitch;
+    ++s;
   }
   else if (c == 'b')
   {
     --note;
+    ++s;
+  }
+
+  return note;
+}
+
+// Parse a rest, or a pitch or chord, at s and advance past it. Return the
+// first pitch index, RestPitch, or ErrorPitch leaving s at the offending
+// pitch. If chord is not 0, store the pitches there, up to MaxChord.
+template<class P>
+int8_t parseNote(P& s, int8_t& whiteIndex, int8_t* chord, uint8_t& chordSize)
+{
+  chordSize = 0;
+  if (*s == '-')
+  {
+    ++s;
+    return whiteIndex = RestPitch;
+  }
+
+  int8_t pitchIndex = parsePitch(s, whiteIndex);
+  if (pitchIndex < 0)
+    return whiteIndex = ErrorPitch;
+
+  int8_t p = pitchIndex;
+  int8_t chordWhiteIndex;
+  while (true)
+  {
+    if (chord != 0 && chordSize < GizmoGardenMusicPlayer::MaxChord)
+      chord[chordSize++] = p;
+    if (*s != '+')
+      break;
+    ++s;
+    p = parsePitch(s, chordWhiteIndex);
+    if (p < 0)
+      return whiteIndex = ErrorPitch;
+  }
+
+  return pitchIndex;
+}
+
+// Parse the note at nextPitch and advance to the following one. Return
+// the pitch index or one of the PitchCodes.
+int8_t GizmoGardenMusicPlayer::getPitchIndex(int8_t& whiteIndex, int8_t* chord,
+                                             uint8_t& chordSize)
+{
+  while (*nextPitch == ' ')
     ++nextPitch;
+
+  if (*nextPitch == 0)
+  {
+    chordSize = 0;
+    return whiteIndex = EndPitch;
   }
 
-  nextPitchIndex = note;
+  int8_t pitchIndex = parseNote(nextPitch, whiteIndex, chord, chordSize);
+  if (pitchIndex != ErrorPitch)
+    ++nextPitchNote;
+  return pitchIndex;
+}
+
+// Move nextPitch to the specified written note. This is sequential
+// except when the durations repeat, which rescans from the start.
+void GizmoGardenMusicPlayer::seekPitch(uint16_t note)
+{
+  if (note < nextPitchNote)
+  {
+    nextPitch = pitches;
+    nextPitchNote = 0;
+  }
+
+  int8_t whiteIndex;
+  uint8_t chordSize;
+  while (nextPitchNote < note)
+    if (getPitchIndex(whiteIndex, 0, chordSize) < RestPitch)
+      break;
 }
 
 const int pitchTable[] PROGMEM =
@@ -98,10 +181,140 @@ const int pitchTable[] PROGMEM =
   2093, 2217, 2349, 2489, 2637, 2794, 2960, 3136, 3322, 3520, 3729, 3951
 };
 
+uint16_t GizmoGardenMusicPlayer::pitchFrequency(int8_t pitchIndex)
+{
+  return pgm_read_word(&pitchTable[pitchIndex]);
+}
+
+uint8_t GizmoGardenMusicPlayer::soundSpace()
+{
+  return GizmoGardenToneQueueSpace();
+}
+
+bool GizmoGardenMusicPlayer::soundPlaying()
+{
+  return GizmoGardenTonePlaying();
+}
+
+void GizmoGardenMusicPlayer::stopSound()
+{
+  GizmoGardenTone(0);
+}
+
+void GizmoGardenMusicPlayer::sound(const int8_t* chord, uint8_t chordSize,
+                                   uint16_t d, uint16_t duration)
+{
+  if (chordSize > 0)
+    GizmoGardenToneQueue(pitchFrequency(chord[0]), d);
+  if (d < duration)
+    GizmoGardenToneQueue(0, duration - d);
+}
+
+int8_t GizmoGardenMusicPlayer::readTextNote(uint8_t& ticks, int8_t& whiteIndex,
+                                            int8_t* chord, uint8_t& chordSize,
+                                            bool& repeated)
+{
+  ticks = getMusicTicks(nextDuration, repeats);
+  seekPitch(repeats.noteIndex());
+
+  int8_t pitchIndex = getPitchIndex(whiteIndex, chord, chordSize);
+  if (pitchIndex >= 0)
+  {
+    // Peek at the pitch that plays next, which after a repeat or segment
+    // call is not the next one written. Work on copies, and put the pitch
+    // string back where it was.
+    GizmoGardenText d = nextDuration;
+    GizmoGardenRepeats r = repeats;
+    if (getMusicTicks(d, r) != 0)
+    {
+      GizmoGardenText p = nextPitch;
+      uint16_t n = nextPitchNote;
+      seekPitch(r.noteIndex());
+      int8_t w;
+      uint8_t c;
+      repeated = getPitchIndex(w, 0, c) == pitchIndex;
+      nextPitch = p;
+      nextPitchNote = n;
+    }
+  }
+  return pitchIndex;
+}
+
+int8_t GizmoGardenMusicPlayer::readStreamNote(uint8_t& ticks, int8_t& whiteIndex,
+                                              int8_t* chord, uint8_t& chordSize,
+                                              bool& repeated)
+{
+  char word[GizmoGardenMusicStream::MaxWord];
+  if (!stream->readWord(word))
+    return WaitPitch;
+
+  if (word[0] == GizmoGardenMusicStream::EndChar)
+    return EndPitch;
+
+  const char* s = word;
+  int8_t pitchIndex = parseNote(s, whiteIndex, chord, chordSize);
+  ticks = getMusicTicks(s);
+  if (*s != 0)
+    ticks = 0;
+
+  if (pitchIndex >= 0 && stream->peekWord(word))
+  {
+    s = word;
+    int8_t w;
+    uint8_t c;
+    repeated = parseNote(s, w, 0, c) == pitchIndex;
+  }
+  return pitchIndex;
+}
+
 void GizmoGardenMusicPlayer::myTurn()
 {
-  int8_t currentPitchIndex = nextPitchIndex;
-  int8_t currentWhiteIndex = nextWhiteIndex;
+  if (clock != 0)
+  {
+    uint32_t t = clock->join(position);
+    if (t != 0)
+    {
+      callMeAt(t);
+      return;
+    }
+  }
+
+  // Clear out whatever was left by the previous music, and start the
+  // timeline on the first turn. A stream must first fill its buffer.
+  if (noteTime == NotStarted)
+  {
+    if (stream != 0 && !stream->primed())
+    {
+      callMe(1);
+      return;
+    }
+    stopSound();
+    noteTime = millis();
+  }
+
+  // Very short notes can get ahead of the queue. A note and its
+  // separating rest need two entries.
+  if (soundSpace() < 2)
+  {
+    callMe(1);
+    return;
+  }
+
+  uint8_t ticks = 0;
+  int8_t currentWhiteIndex;
+  int8_t chord[MaxChord];
+  uint8_t chordSize = 0;
+  bool repeated = false;
+  int8_t currentPitchIndex = stream != 0 ?
+    readStreamNote(ticks, currentWhiteIndex, chord, chordSize, repeated) :
+    readTextNote  (ticks, currentWhiteIndex, chord, chordSize, repeated);
+
+  // The stream ran dry. Whatever is queued keeps playing meanwhile.
+  if (currentPitchIndex == WaitPitch)
+  {
+    callMe(1);
+    return;
+  }
 
   if (currentPitchIndex == EndPitch)
   {
@@ -115,28 +328,48 @@ void GizmoGardenMusicPlayer::myTurn()
     return;
   }
 
-  uint16_t duration = getMusicTime(nextDuration, beatLength);
-  if (duration == 0)
+  if (ticks == 0)
   {
     endCode = DurationError;
     return;
   }
 
-  getPitchIndex();
+  // The note is queued to start when the previous one ends, so its
+  // duration is just the distance between ideal note times.
+  uint16_t duration;
+  if (clock != 0)
+  {
+    uint32_t t = clock->timeOf(position);
+    position += ticks;
+    noteTime = clock->timeOf(position);
+    duration = (uint16_t)(noteTime - t);
+  }
+  else
+  {
+    duration = musicTicksToTime(ticks, beatLength);
+    noteTime += duration;
+  }
 
-  // zero pitch is a rest, chill out and do nothing if the pitch is a rest
-  if (currentPitchIndex >= 0)
+  // With nothing playing, the note starts now rather than when the previous
+  // one ended, which is late after the first turn, a join, or the queue
+  // running dry. Cut it to end on time, so the sound stays on the timeline.
+  if (!soundPlaying())
   {
-    // If sequential pitches are identical, shorten the first one to separate them
-    // as distinct notes.
-    uint16_t d = duration;
-    if (nextPitchIndex == currentPitchIndex)
-      d -= d >> 2;
-    GizmoGardenTone(pgm_read_word(&pitchTable[currentPitchIndex]), d);
+    int32_t left = (int32_t)(noteTime - millis());
+    duration = left > 0 ? (uint16_t)min(left, (int32_t)duration) : 0;
   }
 
-  // hold off on playing any more notes until the current note is done playing
-  callMe(duration);
+  // A rest is queued as silence so that the following notes stay on time.
+  // If sequential pitches are identical, shorten the first one to separate
+  // them as distinct notes.
+  uint16_t d = chordSize > 0 ? duration : 0;
+  if (repeated)
+    d -= d >> 2;
+  if (duration > 0)
+    sound(chord, chordSize, d, duration);
+
+  // Come back a little before the current note is done, to queue the next one
+  callMeAt(noteTime - ToneLead);
   customNote(currentPitchIndex, currentWhiteIndex);
 }
 
@@ -149,6 +382,9 @@ GizmoGardenText GizmoGardenMusicPlayer::getStatus() const
   if (isRunning())
     return F("Running");
 
+  if (stream != 0 && endCode > ForcedEnd)
+    return F("Bad note");
+
   switch (getEndCode())
   {
   case NormalEnd:
@@ -157,7 +393,7 @@ GizmoGardenText GizmoGardenMusicPlayer::getStatus() const
     return F("Stopped");
 
   case PitchError:
-    return nextPitch - 1;
+    return nextPitch;
 
   case DurationError:
     return nextDuration;
@@ -12,6 +12,7 @@ a particular purpose.
 
 #include "../GizmoGarden_Common/GizmoGardenCommon.h"
 #include "../GizmoGarden_Multitasking/GizmoGardenMultitasking.h"
+#include "GizmoGardenMusicStream.h"
 
 // ******************
 // *                *
@@ -34,9 +35,29 @@ a particular purpose.
 // A - (dash) can be used is place of <note><octave> characters to
 // signify a rest.
 //
+// Pitches joined by + (plus), with no spaces, form a chord that counts
+// as one note, for example C6+E6+G6. GizmoGardenTone plays only the
+// first pitch; a player with a polyphonic backend, such as
+// GizmoGardenPolyPlayer, plays them all.
+//
+// Music can also be played from a GizmoGardenMusicStream, which reads it
+// incrementally from Serial or an SD card file. See GizmoGardenMusicStream.h
+// for the format.
+//
+// The duration string can use the repeat and segment markers described
+// in GizmoGardenCommon.h. The pitch string has no markers; each pitch
+// is written once, for the corresponding note in the duration string as
+// written, and is replayed along with the repeated durations.
+//
+// Notes are queued with GizmoGardenToneQueue, and the timer interrupt
+// starts each one exactly when the previous one ends. The task runs
+// ToneLead milliseconds before each note ends to queue the next, so
+// it can be that late without leaving a gap.
+//
 // One can derive a class from GizmoGardenMusicPlayer that makes
 // use of currentNote and currentWhiteNote to do some related
-// action, synchronized to the music.
+// action, synchronized to the music. customNote is called when a
+// note is queued, about ToneLead milliseconds before it sounds.
 
 class GizmoGardenMusicPlayer : public GizmoGardenTask
 {
@@ -46,6 +67,10 @@ public:
   int getBeatLength() const { return beatLength; }
   void setBeatLength(int bl) { beatLength = bl; }
 
+  // Follow the specified beat clock instead of beatLength, or stop
+  // following if 0. See GizmoGardenMultitasking.h.
+  void setBeatClock(GizmoGardenBeatClock* clock);
+
   // Load specified music so that it will play when the task is started. This
   // must be done before each start, since the music is not remembered.
   void loadMusic(GizmoGardenText pitches, GizmoGardenText durations);
@@ -53,6 +78,10 @@ public:
   // Load and start
   void play(GizmoGardenText pitches, GizmoGardenText durations);
 
+  // Same, from a stream. Loading starts the stream reading ahead.
+  void loadMusic(GizmoGardenMusicStream& stream);
+  void play(GizmoGardenMusicStream& stream);
+
   DECLARE_TASK_NAME
 
   enum EndCodes
@@ -67,22 +96,58 @@ public:
   bool normalEnd() const { return endCode == NormalEnd; }
 
   GizmoGardenText getStatus() const;
+
+  enum
+  {
+    ToneLead = 20,
+    MaxChord = 4      // Pitches of a chord beyond this are ignored
+  };
   
 private:
+  GizmoGardenText pitches;
   GizmoGardenText nextPitch;
+  uint16_t nextPitchNote;     // Written index of the pitch at nextPitch
   GizmoGardenText nextDuration;
+  GizmoGardenRepeats repeats;
   int beatLength;
 
-  int8_t nextPitchIndex;
-  int8_t nextWhiteIndex;
+  GizmoGardenBeatClock* clock;
+  uint32_t position;
+
+  GizmoGardenMusicStream* stream;
+
+  // Ideal time that the queued notes end
+  enum { NotStarted = 0 };
+  uint32_t noteTime;
 
   uint8_t endCode;
 
-  void getPitchIndex();
+  int8_t getPitchIndex(int8_t& whiteIndex, int8_t* chord, uint8_t& chordSize);
+  void seekPitch(uint16_t note);
+
+  // Get the next note from the strings or the stream. Return the pitch
+  // index or one of the PitchCodes.
+  int8_t readTextNote  (uint8_t& ticks, int8_t& whiteIndex, int8_t* chord,
+                        uint8_t& chordSize, bool& repeated);
+  int8_t readStreamNote(uint8_t& ticks, int8_t& whiteIndex, int8_t* chord,
+                        uint8_t& chordSize, bool& repeated);
 
 protected:
   virtual void myTurn();
   virtual void customNote(int pitchIndex, int whiteIndex);
+
+  // The sound backend, GizmoGardenTone by default. sound queues one note,
+  // to start when the previous one ends. It sounds the chordSize pitch
+  // indexes in chord for d milliseconds, followed by silence for the rest
+  // of duration. A chordSize of 0 is a rest. soundSpace is the number of
+  // entries that can be queued, of which sound may use two. soundPlaying is
+  // false when the queue has run out, so the next note starts right away.
+  virtual uint8_t soundSpace();
+  virtual bool soundPlaying();
+  virtual void stopSound();
+  virtual void sound(const int8_t* chord, uint8_t chordSize, uint16_t d, uint16_t duration);
+
+  static uint16_t pitchFrequency(int8_t pitchIndex);
 };
 
 #define MakeMusicPlayer(name, beatLength)                     \
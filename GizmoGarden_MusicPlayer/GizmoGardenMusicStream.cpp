@@ -0,0 +1,150 @@
+/********************************************************************
+Copyright (c) 2015 Bill Silver (gizmogarden.org). This source code is
+distributed under terms of the GNU General Public License, Version 3,
+which grants certain rights to copy, modify, and redistribute. The
+license can be found at <http://www.gnu.org/licenses/>. There is no
+express or implied warranty, including merchantability or fitness for
+a particular purpose.
+********************************************************************/
+
+#include "GizmoGardenMusicStream.h"
+
+GizmoGardenMusicStream::GizmoGardenMusicStream(Stream& source, char* buffer, uint8_t size)
+  : source(source), buffer(buffer), size(size), prefetch(size / 2),
+    owed(0), flowControl(false), endOnEmpty(false), GizmoGardenTask(false)
+{
+  customStart();
+}
+
+#ifdef TASK_MONITOR
+GizmoGardenText GizmoGardenMusicStream::name() const
+{
+  return F("Stream"); 
+}
+#endif
+
+// The sender keeps any credit it was given and hasn't used, so owed carries
+// over to the next music rather than being granted again.
+void GizmoGardenMusicStream::customStart()
+{
+  head = fill = 0;
+  lowWater = size;
+  underruns = 0;
+  ended = starving = false;
+}
+
+void GizmoGardenMusicStream::push(char c)
+{
+  uint16_t i = head + fill;
+  if (i >= size)
+    i -= size;
+  buffer[i] = c;
+  ++fill;
+}
+
+void GizmoGardenMusicStream::myTurn()
+{
+  while (fill < size && !ended)
+  {
+    if (source.available() <= 0)
+    {
+      if (endOnEmpty)
+      {
+        push(EndChar);
+        ended = true;
+      }
+      break;
+    }
+
+    char c = source.read();
+    push(c);
+    if (owed > 0)
+      --owed;
+    if (c == EndChar)
+      ended = true;
+  }
+
+  if (ended)
+    return;
+
+  // Allow the sender as much as will fit in the buffer
+  if (flowControl)
+    while (size - fill - owed >= CreditSize)
+    {
+      source.write(CreditChar);
+      owed += CreditSize;
+    }
+
+  callMe(PrefetchInterval);
+}
+
+// Find the next complete word, skipping leading white space, and copy it
+// to word. Return the number of buffer characters it used, or 0 if it
+// isn't complete. A ; written right after a note ends the note and is
+// left in the buffer to be the next word. A word too long for MaxWord is
+// cut off, and will be rejected by the player.
+uint8_t GizmoGardenMusicStream::scanWord(char* word) const
+{
+  uint8_t n = 0;
+  uint8_t length = 0;
+  uint8_t i = head;
+  while (n < fill)
+  {
+    char c = buffer[i];
+    ++n;
+    if (++i == size)
+      i = 0;
+
+    if (c == ' ' || c == '\n' || c == '\r' || c == '\t')
+    {
+      if (length > 0)
+        break;
+    }
+    else
+    {
+      if (c == EndChar && length > 0)
+      {
+        --n;
+        break;
+      }
+
+      word[length++] = c;
+      if (c == EndChar || length == MaxWord - 1)
+        break;
+    }
+
+    if (n == fill)
+      return 0;
+  }
+
+  if (length == 0)
+    return 0;
+
+  word[length] = 0;
+  return n;
+}
+
+bool GizmoGardenMusicStream::peekWord(char* word) const
+{
+  return scanWord(word) > 0;
+}
+
+bool GizmoGardenMusicStream::readWord(char* word)
+{
+  uint8_t n = scanWord(word);
+  if (n == 0)
+  {
+    if (!starving)
+      ++underruns;
+    starving = true;
+    return false;
+  }
+
+  head += n;
+  if (head >= size)
+    head -= size;
+  fill -= n;
+  lowWater = min(lowWater, fill);
+  starving = false;
+  return true;
+}
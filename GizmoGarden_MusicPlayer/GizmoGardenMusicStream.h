@@ -0,0 +1,105 @@
+#ifndef _GizmoGardenMusicStream_
+#define _GizmoGardenMusicStream_
+
+/********************************************************************
+Copyright (c) 2015 Bill Silver (gizmogarden.org). This source code is
+distributed under terms of the GNU General Public License, Version 3,
+which grants certain rights to copy, modify, and redistribute. The
+license can be found at <http://www.gnu.org/licenses/>. There is no
+express or implied warranty, including merchantability or fitness for
+a particular purpose.
+********************************************************************/
+
+#include "../GizmoGarden_Common/GizmoGardenCommon.h"
+#include "../GizmoGarden_Multitasking/GizmoGardenMultitasking.h"
+
+// ******************
+// *                *
+// *  Music Stream  *
+// *                *
+// ******************
+
+// GizmoGardenMusicStream is a task that feeds GizmoGardenMusicPlayer from
+// a Stream, such as Serial or an SD card File, so that the length of a song
+// is not limited by flash memory. Characters are read ahead of the player
+// into a ring buffer supplied by the caller, of up to 255 characters. It
+// must hold at least MaxWord + CreditSize characters, and more gives more
+// protection against a slow sender.
+//
+// Because pitches and durations arrive together, each note is written as
+// one word, the pitch immediately followed by its duration, for example
+// "C6Q D6E. -S E6+G6H". Words are separated by spaces or newlines, and the
+// music ends with a ; (semicolon), which may follow the last note directly.
+// The repeat and segment markers are not available, since a stream can't
+// go back.
+//
+// With flow control on, the sender must wait for a > character before
+// sending each CreditSize characters. This keeps Serial from overflowing
+// when the ring buffer is full. Without it the sender must pace itself.
+// Credit the sender hasn't used when the music ends is kept for the next
+// music, so the sender should keep counting it too.
+//
+// The stream counts underruns, which are times the player found no complete
+// note in the buffer and had to wait, and the low water mark of the buffer,
+// to help choose the buffer size and sending rate.
+
+class GizmoGardenMusicStream : public GizmoGardenTask
+{
+public:
+  GizmoGardenMusicStream(Stream& source, char* buffer, uint8_t size);
+
+  enum
+  {
+    EndChar          = ';',
+    CreditChar       = '>',
+    CreditSize       = 8,
+    MaxWord          = 24,   // Longest note, including terminating 0
+    PrefetchInterval = 2     // Milliseconds between reads of the source
+  };
+
+  void setFlowControl(bool on) { flowControl = on; }
+
+  // Treat running out of characters as the end of the music, for a File.
+  void setEndOnEmpty(bool on) { endOnEmpty = on; }
+
+  // The player waits to start until this many characters are buffered, or
+  // the end of the music is. The default is half the buffer.
+  void setPrefetch(uint8_t n) { prefetch = n; }
+  bool primed() const { return ended || fill >= prefetch; }
+
+  // Copy the next note to word, which must hold MaxWord characters, and
+  // return true, or return false if it hasn't all arrived. readWord removes
+  // it from the buffer and peekWord doesn't.
+  bool readWord(char* word);
+  bool peekWord(char* word) const;
+
+  uint8_t getFill() const { return fill; }
+  uint8_t getLowWater() const { return lowWater; }
+  uint16_t getUnderruns() const { return underruns; }
+
+  DECLARE_TASK_NAME
+
+protected:
+  virtual void myTurn();
+  virtual void customStart();
+
+private:
+  Stream& source;
+  char* buffer;
+  uint8_t size;
+  uint8_t head;
+  uint8_t fill;
+  uint8_t owed;       // Characters credited to the sender but not yet received
+  uint8_t prefetch;
+  uint8_t lowWater;
+  uint16_t underruns;
+  bool flowControl;
+  bool endOnEmpty;
+  bool ended;
+  bool starving;
+
+  void push(char c);
+  uint8_t scanWord(char* word) const;
+};
+
+#endif
@@ -0,0 +1,61 @@
+// ***************************************
+// *                                     *
+// *  Gizmo Garden Music Stream Example  *
+// *                                     *
+// ***************************************
+//
+// Plays music sent over Serial, so that a long show isn't limited by flash
+// memory. Each note is one word, the pitch immediately followed by the
+// duration, and the music ends with a semicolon, for example:
+//
+//   C6Q C6Q C6E. D6S E6Q E6E. D6S E6E. F6S G6H ;
+//
+// Flow control is on, so the sender waits for a > character before sending
+// each 8 characters. The Serial Monitor can't do that, but a short song typed
+// into it fits in the buffer anyway.
+
+#include <GizmoGardenCommon.h>
+#include <GizmoGardenMultitasking.h>
+#include <GizmoGardenTone.h>
+#include <GizmoGardenMusicPlayer.h>
+
+enum DigitalPins
+{
+  TonePin1        =  4,   // One terminal of the piezo buzzer
+  TonePin2        =  5,   // Other terminal
+};
+
+char streamBuffer[128];
+GizmoGardenMusicStream stream(Serial, streamBuffer, sizeof(streamBuffer));
+GizmoGardenMusicPlayer player(400);   // quarter note is 400 ms
+
+// Start the player whenever it's idle, so that it waits for the next song.
+// Report how the last one went.
+MakeGizmoGardenTask(Restart)
+{
+  if (!player.isRunning())
+  {
+    Serial.print(F("Underruns "));
+    Serial.print(stream.getUnderruns());
+    Serial.print(F(", low water "));
+    Serial.println(stream.getLowWater());
+    player.play(stream);
+  }
+  callMe(100);
+}
+
+void setup()
+{
+  Serial.begin(115200);
+  GizmoGardenTask::begin();
+  GizmoGardenToneBegin(TonePin1, TonePin2);
+
+  stream.setFlowControl(true);
+  player.play(stream);
+  Restart.start();
+}
+
+void loop()
+{
+  GizmoGardenTask::run();
+}
@@ -18,10 +18,39 @@
 #endif
 
 GizmoGardenPixels::GizmoGardenPixels(uint16_t numPixels, uint8_t pin)
-: Adafruit_NeoPixel(numPixels, pin)
+: Adafruit_NeoPixel(numPixels, pin), output(0), outputSize(0), ownOutput(true), level(255),
+  gamma(false), sendOutput(false), dirty(true), shownCount(0), skippedCount(0),
+  droppedCount(0), latencyMax(0)
 {
 }
 
+GizmoGardenPixels::GizmoGardenPixels(uint8_t* buffer, uint16_t bufferSize, uint8_t pin,
+                                     neoPixelType type, uint8_t* outputBuffer)
+: output(0), outputSize(0), ownOutput(true), level(255), gamma(false), sendOutput(false),
+  dirty(true), shownCount(0), skippedCount(0), droppedCount(0), latencyMax(0)
+{
+  updateType(type);
+  uint8_t order = getColorOrder();
+  setBuffer(buffer, bufferSize / ((order >> 6) == ((order >> 4) & 3) ? 3 : 4));
+  setPin(pin);
+
+  if (outputBuffer != 0)
+  {
+    output = outputBuffer;
+    outputSize = getNumBytes();
+    ownOutput = false;
+    sendOutput = true;
+  }
+}
+
+GizmoGardenPixels::~GizmoGardenPixels()
+{
+  // Make sure the servo interrupt doesn't show from a freed buffer
+  cancel();
+  if (ownOutput && output != 0)
+    free(output);
+}
+
 // To satisfy NeoPixl timing requirements, we need to guarantee that the start
 // of one showInterrupt() is at least 50 us later than the end of the previous.
 // Adafruit uses calls to micros() to guarantee the timing without wasting time
@@ -33,55 +62,233 @@ GizmoGardenPixels::GizmoGardenPixels(uint16_t numPixels, uint8_t pin)
 // 50 us is needed.
 //
 // Instead of micros(), we use the 8-bit hardware counter in timer 0. Since the
-// counter only gives time modulo 256, we can delay by up to 50 us when in fact
-// no delay is necessary. But 50 us is worst case; the expected value of the
-// unnecessary delay is only about 1.25 us, which is negligable, and we avoid
+// counter only gives time modulo 256, we can delay by up to the latch time when
+// in fact no delay is necessary. But that is worst case; the expected value of
+// the unnecessary delay is only about 1.25 us, which is negligable, and we avoid
 // the possibility of a much longer unnecessary delay.
 //
 // Note that there is no need to initialize endMark; any random initial value
 // will do.
 
+// Timer 0 ticks in the 50 us latch, rounded up. endMark can be read at the
+// very end of its tick, so the count has to go one past this to be sure that
+// a whole 50 us has gone by.
+static const uint8_t LatchTicks = (50 * clockCyclesPerMicrosecond() + 63) / 64;
+
 void GizmoGardenPixels::callback()
 {
-  // This works because it is an unsigned comparison. Note that 50 us converted
-  // to timer ticks with integer math truncates to 48 us, but surely there is at
-  // least 2 us overhead between calls to show().
-  while ((uint8_t)(TCNT - endMark) < (uint8_t)(50 * clockCyclesPerMicrosecond() / 64));
-  showInterrupt();
+  // This works because it is an unsigned comparison
+  while ((uint8_t)(TCNT - endMark) <= LatchTicks);
+  showInterrupt(sendOutput ? output : NULL);
   endMark = TCNT;
+  ++shownCount;
+
+  // millis() doesn't advance with interrupts off, so a show that waited behind
+  // others in the same safe time looks as if it went out when they started.
+  // Close enough for a number that counts servo frames.
+  uint16_t latency = (uint16_t)millis() - requestTime;
+  if (latency > latencyMax)
+    latencyMax = latency;
+}
+
+// The latch wait, at most one tick more than LatchTicks, plus the bits
+uint16_t GizmoGardenPixels::callbackTime()
+{
+  return (LatchTicks + 1) * 64 / clockCyclesPerMicrosecond() + getShowTime();
 }
 
+// The strip is clean as soon as a show is asked for. Anything that cancels
+// a waiting show also marks the strip dirty again, so it can't be lost.
 void GizmoGardenPixels::show()
 {
+  if (!dirty)
+  {
+    ++skippedCount;
+    return;
+  }
+  dirty = false;
+
+  // A show still waiting for the servos is replaced by this one, and with the
+  // output buffer it must not go out half rendered
+  drop();
+  sendOutput = output != 0 && outputSize == getNumBytes();
+  if (sendOutput)
+    render();
+  requestTime = (uint16_t)millis();
   call();
 }
 
+void GizmoGardenPixels::drop()
+{
+  if (cancel())
+    ++droppedCount;
+}
+
+void GizmoGardenPixels::getShowCounts(uint16_t& shown, uint16_t& skipped, uint16_t& dropped)
+{
+  uint8_t saveSREG = SREG;
+  cli();
+  shown = shownCount;
+  shownCount = 0;
+  SREG = saveSREG;
+
+  skipped = skippedCount;
+  skippedCount = 0;
+  dropped = droppedCount;
+  droppedCount = 0;
+}
+
+uint16_t GizmoGardenPixels::getLatency()
+{
+  uint8_t saveSREG = SREG;
+  cli();
+  uint16_t latency = latencyMax;
+  latencyMax = 0;
+  SREG = saveSREG;
+  return latency;
+}
+
 void GizmoGardenPixels::setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b)
 {
-  cancel();
+  changing();
   Adafruit_NeoPixel::setPixelColor(n, r, g, b);
 }
 
 void GizmoGardenPixels::setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b, uint8_t w)
 {
-  cancel();
+  changing();
   Adafruit_NeoPixel::setPixelColor(n, r, g, b, w);
 }
 
 void GizmoGardenPixels::setPixelColor(uint16_t n, uint32_t c)
 {
-  cancel();
+  changing();
   Adafruit_NeoPixel::setPixelColor(n, c);
 }
 
+uint8_t* GizmoGardenPixels::beginWrite(uint16_t first, uint16_t& count)
+{
+  uint16_t n = numPixels();
+  if (first >= n || count == 0)
+    return 0;
+  if (count > n - first)
+    count = n - first;
+
+  changing();
+  return getPixels() + first * (getNumBytes() / n);
+}
+
+
+// Make the first pixel with putColor, then copy its bytes to the rest
+void GizmoGardenPixels::fill(uint32_t color, uint16_t first, uint16_t count)
+{
+  uint8_t* p = beginWrite(first, count);
+  if (p == 0)
+    return;
+
+  uint8_t size = getNumBytes() / numPixels();
+  putColor(p, color, getColorOrder(), writeScale());
+
+  uint8_t* end = p + count * size;
+  for (uint8_t* q = p + size; q < end; ++q)
+    *q = q[-size];
+}
+
 void GizmoGardenPixels::setBrightness(uint8_t z)
 {
-  cancel();
-  Adafruit_NeoPixel::setBrightness(z);
+  if (output != 0)
+    // Takes effect at the next show
+    level = z;
+  else
+  {
+    drop();
+    Adafruit_NeoPixel::setBrightness(z);
+  }
+  dirty = true;
+}
+
+uint8_t GizmoGardenPixels::getBrightness() const
+{
+  return output != 0 ? level : Adafruit_NeoPixel::getBrightness();
 }
 
 void GizmoGardenPixels::clear()
 {
-  cancel();
+  changing();
   Adafruit_NeoPixel::clear();
 }
+
+// **********************************
+// *                                *
+// *  Output Buffer for Brightness  *
+// *                                *
+// **********************************
+
+// The buffer is sized for the strip length when this is called. If the length
+// is changed later with updateLength, call this again, otherwise show() sends
+// the stored colors as they are, with neither brightness nor double buffering.
+bool GizmoGardenPixels::useOutputBuffer()
+{
+  uint16_t n = getNumBytes();
+  if (n != outputSize)
+  {
+    drop();
+    sendOutput = false;
+    dirty = true;
+    // A buffer that didn't come from malloc is just left behind
+    uint8_t* p = (uint8_t*)realloc(ownOutput ? output : 0, n);
+    if (p == 0)
+      return false;
+    ownOutput = true;
+
+    if (output == 0)
+    {
+      // Take over the brightness from Adafruit_NeoPixel, and scale the stored
+      // colors back up as well as they can be
+      level = Adafruit_NeoPixel::getBrightness();
+      Adafruit_NeoPixel::setBrightness(255);
+    }
+    output = p;
+    outputSize = n;
+    sendOutput = true;
+  }
+  return true;
+}
+
+// Gamma 2.8, out = 255 * (in / 255) ^ 2.8, rounded
+static const uint8_t PROGMEM gammaTable[256] =
+{
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+    0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   1,   1,   1,
+    1,   1,   1,   1,   1,   1,   1,   1,   1,   2,   2,   2,   2,   2,   2,   2,
+    2,   3,   3,   3,   3,   3,   3,   3,   4,   4,   4,   4,   4,   5,   5,   5,
+    5,   6,   6,   6,   6,   7,   7,   7,   7,   8,   8,   8,   9,   9,   9,  10,
+   10,  10,  11,  11,  11,  12,  12,  13,  13,  13,  14,  14,  15,  15,  16,  16,
+   17,  17,  18,  18,  19,  19,  20,  20,  21,  21,  22,  22,  23,  24,  24,  25,
+   25,  26,  27,  27,  28,  29,  29,  30,  31,  32,  32,  33,  34,  35,  35,  36,
+   37,  38,  39,  39,  40,  41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  50,
+   51,  52,  54,  55,  56,  57,  58,  59,  60,  61,  62,  63,  64,  66,  67,  68,
+   69,  70,  72,  73,  74,  75,  77,  78,  79,  81,  82,  83,  85,  86,  87,  89,
+   90,  92,  93,  95,  96,  98,  99, 101, 102, 104, 105, 107, 109, 110, 112, 114,
+  115, 117, 119, 120, 122, 124, 126, 127, 129, 131, 133, 135, 137, 138, 140, 142,
+  144, 146, 148, 150, 152, 154, 156, 158, 160, 162, 164, 167, 169, 171, 173, 175,
+  177, 180, 182, 184, 186, 189, 191, 193, 196, 198, 200, 203, 205, 208, 210, 213,
+  215, 218, 220, 223, 225, 228, 231, 233, 236, 239, 241, 244, 247, 249, 252, 255,
+};
+
+// Brightness scales as in Adafruit_NeoPixel, by (level + 1) / 256, so 255
+// leaves the colors as they are. Gamma goes after brightness, so that steps
+// in brightness look even too.
+void GizmoGardenPixels::render()
+{
+  const uint8_t* p = getPixels();
+  uint16_t scale = level + 1;
+  if (level == 255 && !gamma)
+    memcpy(output, p, outputSize);
+  else if (gamma)
+    for (uint16_t i = 0; i < outputSize; ++i)
+      output[i] = pgm_read_byte(&gammaTable[((uint16_t)p[i] * scale) >> 8]);
+  else
+    for (uint16_t i = 0; i < outputSize; ++i)
+      output[i] = (uint8_t)(((uint16_t)p[i] * scale) >> 8);
+}
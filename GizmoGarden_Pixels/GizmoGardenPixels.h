@@ -28,21 +28,303 @@ class GizmoGardenPixels : public Adafruit_NeoPixel, private ServoCallback
 {
 public:
   GizmoGardenPixels(uint16_t numPixels, uint8_t pin);
+  ~GizmoGardenPixels();
 
   void show();
   void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b);
   void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b, uint8_t w);
   void setPixelColor(uint16_t n, uint32_t c);
   void setBrightness(uint8_t);
+  uint8_t getBrightness() const;
   void clear();
 
+  // Set count pixels starting at first, all to one color or each from a packed
+  // color like those of Color(). colors can be a plain pointer to an array in RAM,
+  // or a ProgSpacePointer to an image in flash. Much faster than the same loop of
+  // setPixelColor calls, because the range check, color order, and servo callback
+  // bookkeeping are done once and not for every pixel. Pixels past the end of the
+  // strip are left out.
+  void fill(uint32_t color, uint16_t first = 0, uint16_t count = 0xFFFF);
+  template<class P>
+  void setPixels(uint16_t first, P colors, uint16_t count);
+
+  // Normally setBrightness works as in Adafruit_NeoPixel, scaling the stored colors
+  // in place. That loses precision, so fading down and back up spoils the picture,
+  // and getPixelColor has to divide to undo the scaling. After useOutputBuffer, the
+  // stored colors are kept exactly as set, and show() applies brightness, and gamma
+  // if turned on, into a second buffer of the same size that goes to the strip.
+  //
+  // The second buffer also makes a front and back buffer. Without it, a show that
+  // is waiting for a safe time in the servo frame is cancelled by the first change
+  // to the pixels, so under servo load a task drawing every frame may have many of
+  // its frames never shown. With it, show() latches the frame into the front buffer
+  // and drawing goes on in the back; a waiting show is only replaced by the next
+  // show(). Costs 3 or 4 bytes of RAM per pixel. Returns false if there isn't
+  // enough memory.
+  bool useOutputBuffer();
+
+  // Gamma correction makes equal steps in color values look like equal steps in
+  // brightness, so fades look smooth. Needs useOutputBuffer.
+  void setGamma(bool on) { gamma = on; dirty = true; }
+
+  // show() does nothing if nothing has changed since the last call to it, so
+  // a task can call it every time around without costing interrupts-off time or
+  // a servo safe time for nothing. The functions here keep track of changes; if
+  // you write pixels through getPixels(), call pixelsChanged() afterwards.
+  void pixelsChanged() { dirty = true; }
+
+  // Shows sent to the strip, shows skipped because nothing had changed, and
+  // shows dropped because they were cancelled or replaced while waiting for
+  // the servos, all since the last call
+  void getShowCounts(uint16_t& shown, uint16_t& skipped, uint16_t& dropped);
+
+  // Longest time in milliseconds from show() to the pixels going out, since
+  // the last call. With several strips, shows that don't all fit in one servo
+  // safe time go out in the next ones; see ServoCallback in GizmoGardenServo.h.
+  uint16_t getLatency();
+
 protected:
+  // For strips that keep their pixels in a buffer of their own instead of one
+  // from malloc. The strip has as many pixels of the given type as fit in
+  // bufferSize bytes. If outputBuffer is given, it must be the same size, and
+  // the strip starts out as if useOutputBuffer had been called.
+  GizmoGardenPixels(uint8_t* buffer, uint16_t bufferSize, uint8_t pin, neoPixelType type,
+                    uint8_t* outputBuffer = 0);
+
   virtual void callback();
+  virtual uint16_t callbackTime();
+
+  // Call before changing any pixels. Cancels a waiting show that would send
+  // them, and marks the strip dirty. With the output buffer in use a waiting
+  // show doesn't send them, so this only marks the strip dirty.
+  void changing()
+  {
+    if (!sendOutput)
+      drop();
+    dirty = true;
+  }
+
+  // The Adafruit_NeoPixel brightness as a multiplier, 256 for none. Adafruit
+  // keeps brightness + 1, wrapping to 0 for full.
+  uint16_t writeScale() const
+  {
+    uint8_t b = Adafruit_NeoPixel::getBrightness() + 1;
+    return b != 0 ? b : 256;
+  }
 
 private:
+  // Applies brightness and gamma from the stored colors to output
+  void render();
+
+  // Cancel any waiting show, counting it as dropped
+  void drop();
+
+  // Get ready to write count pixels starting at first, cutting count down to
+  // fit. Returns where the first one goes, or null if there are none.
+  uint8_t* beginWrite(uint16_t first, uint16_t& count);
+
+  // Put a packed color into the bytes of one pixel, in the color order given
+  // by getColorOrder and scaled by the Adafruit_NeoPixel brightness, 256 for
+  // none. Four bytes if w is not the same as r.
+  static void putColor(uint8_t* p, uint32_t color, uint8_t order, uint16_t scale)
+  {
+    uint8_t r = (order >> 4) & 3;
+    uint8_t w = order >> 6;
+    p[r] = (uint8_t)(((uint16_t)(uint8_t)(color >> 16) * scale) >> 8);
+    p[(order >> 2) & 3] = (uint8_t)(((uint16_t)(uint8_t)(color >> 8) * scale) >> 8);
+    p[order & 3] = (uint8_t)(((uint16_t)(uint8_t)color * scale) >> 8);
+    if (w != r)
+      p[w] = (uint8_t)(((uint16_t)(uint8_t)(color >> 24) * scale) >> 8);
+  }
+
+  uint8_t* output;          // null unless useOutputBuffer
+  uint16_t outputSize;
+  bool     ownOutput;       // output came from malloc
+  uint8_t  level;           // brightness with the output buffer, 255 is full
+  bool     gamma;
+  bool     sendOutput;      // a waiting show sends output, so drawing needn't
+                            // cancel it. Set as soon as output is ready, since
+                            // no show is waiting then.
+
+  bool     dirty;           // changed since the last show was asked for
+  volatile uint16_t shownCount;
+  uint16_t skippedCount;
+  uint16_t droppedCount;
+
+  // Low 16 bits of millis() at the last show(), and the longest latency
+  uint16_t requestTime;
+  volatile uint16_t latencyMax;
+
+
   // This is used like endTime in the Adafruit version, to guarantee that at least 50 us
   // separates the end of one show() and the beginning of the next. But the theory of
   // operation is somewhat different, and explained in GizmoGardenPixels.cpp.
   uint8_t endMark;
 };
+template<class P>
+void GizmoGardenPixels::setPixels(uint16_t first, P colors, uint16_t count)
+{
+  uint8_t* p = beginWrite(first, count);
+  if (p == 0)
+    return;
+
+  uint8_t order = getColorOrder();
+  uint8_t size = getNumBytes() / numPixels();
+  uint16_t scale = writeScale();
+  for (uint16_t i = 0; i < count; ++i, p += size)
+    putColor(p, colors[i], order, scale);
+}
+
+// ****************************************
+// *                                      *
+// *  Pixel Strip with Compile-Time Type  *
+// *                                      *
+// ****************************************
+
+// A GizmoGardenPixels whose type and length are template arguments, for example
+//
+//   GizmoGardenPixelStrip<NEO_GRB, 60> ring(NeoPin);
+//
+// The pixels are a member array rather than coming from malloc, so a global strip
+// shows up in the RAM used by the sketch at compile time. setPixelColor and
+// getPixelColor store and load at constant offsets, with no color order lookup and
+// no test for RGB or RGBW, and numPixels is a constant. setPixelColor still tests
+// whether a waiting show has to be cancelled and whether brightness has to be
+// applied, since useOutputBuffer can change both at any time. With Output true, as
+// in GizmoGardenStaticPixels<30, NEO_GRB + NEO_KHZ800, true>, the output buffer is
+// in use from the start, so neither is ever needed and setPixelColor is just the
+// stores and the dirty flag. Everything else is as in GizmoGardenPixels. Don't
+// change the type or length afterwards with updateType or updateLength.
+//
+// Adafruit_NeoPixel doesn't make setPixelColor, getPixelColor, or numPixels
+// virtual, so these hide the ones in GizmoGardenPixels rather than override them.
+// Called through a GizmoGardenPixels& or pointer they still do the right thing,
+// but the slow way. Code that should get the speed needs the strip's own type.
+template<neoPixelType Type, uint16_t Pixels, bool Output = false>
+class GizmoGardenPixelStrip : public GizmoGardenPixels
+{
+public:
+  enum
+  {
+    W = (Type >> 6) & 3,
+    R = (Type >> 4) & 3,
+    G = (Type >> 2) & 3,
+    B = Type & 3,
+    PixelSize = W == R ? 3 : 4,
+  };
+
+  GizmoGardenPixelStrip(uint8_t pin)
+    : GizmoGardenPixels(buffer, sizeof(buffer), pin, Type)
+  {
+    static_assert(!Output, "an Output strip needs an output buffer");
+  }
+
+protected:
+  // With an output buffer of sizeof(buffer) bytes, in use from the start. Output
+  // must be true if outputBuffer isn't null.
+  GizmoGardenPixelStrip(uint8_t pin, uint8_t* outputBuffer)
+    : GizmoGardenPixels(buffer, sizeof(buffer), pin, Type, outputBuffer)
+  {}
+
+public:
+
+  uint16_t numPixels() const { return Pixels; }
+
+  void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b)
+  {
+    if (n < Pixels)
+      put(buffer + n * PixelSize, r, g, b, 0);
+  }
+
+  void setPixelColor(uint16_t n, uint8_t r, uint8_t g, uint8_t b, uint8_t w)
+  {
+    if (n < Pixels)
+      put(buffer + n * PixelSize, r, g, b, w);
+  }
+
+  void setPixelColor(uint16_t n, uint32_t c)
+  {
+    if (n < Pixels)
+      put(buffer + n * PixelSize, (uint8_t)(c >> 16), (uint8_t)(c >> 8), (uint8_t)c,
+          (uint8_t)(c >> 24));
+  }
+
+  // Scaled by Adafruit_NeoPixel brightness, the colors have to be worked out
+  // the slow way
+  uint32_t getPixelColor(uint16_t n) const
+  {
+    if (n >= Pixels)
+      return 0;
+    if (!Output && writeScale() != 256)
+      return GizmoGardenPixels::getPixelColor(n);
+    const uint8_t* p = buffer + n * PixelSize;
+    return (PixelSize == 4 ? (uint32_t)p[W] << 24 : 0) |
+           (uint32_t)p[R] << 16 | (uint16_t)p[G] << 8 | p[B];
+  }
+
+private:
+  uint8_t buffer[Pixels * PixelSize];
+
+  // PixelSize, the offsets, and Output are constants, so the compiler drops
+  // the code that doesn't apply. Without Output there are two tests left:
+  // changing() cancels a waiting show unless the output buffer is in use, and
+  // the colors are scaled if Adafruit_NeoPixel brightness is set.
+  void put(uint8_t* p, uint8_t r, uint8_t g, uint8_t b, uint8_t w)
+  {
+    if (Output)
+      pixelsChanged();
+    else
+    {
+      changing();
+      uint16_t scale = writeScale();
+      if (scale != 256)
+      {
+        r = (uint8_t)(((uint16_t)r * scale) >> 8);
+        g = (uint8_t)(((uint16_t)g * scale) >> 8);
+        b = (uint8_t)(((uint16_t)b * scale) >> 8);
+        w = (uint8_t)(((uint16_t)w * scale) >> 8);
+      }
+    }
+    p[R] = r;
+    p[G] = g;
+    p[B] = b;
+    if (PixelSize == 4)
+      p[W] = w;
+  }
+};
+
+// *********************************
+// *                               *
+// *  Statically Allocated Pixels  *
+// *                               *
+// *********************************
+
+// A GizmoGardenPixels with its pixels in a member array instead of on the heap,
+// which on a 2K processor can fragment and doesn't show in the RAM that the
+// compiler reports for the sketch. Use it just like GizmoGardenPixels:
+//
+//   GizmoGardenStaticPixels<30> ring(NeoPin);
+//   GizmoGardenStaticPixels<30, NEO_GRBW + NEO_KHZ800> rgbwRing(NeoPin);
+//
+// It is a GizmoGardenPixelStrip with the length first and the type defaulting as
+// in Adafruit_NeoPixel, so the type is fixed when the strip is made and the buffer
+// is the right size for it. With Output true, the output buffer of useOutputBuffer
+// is a member array too, and is in use from the start, which also makes
+// setPixelColor as fast as it can be. Nothing here touches the
+// heap, as long as the type and length aren't changed afterwards with updateType
+// or updateLength.
+template<uint16_t Pixels, neoPixelType Type = NEO_GRB + NEO_KHZ800, bool Output = false>
+class GizmoGardenStaticPixels : public GizmoGardenPixelStrip<Type, Pixels, Output>
+{
+  typedef GizmoGardenPixelStrip<Type, Pixels, Output> Strip;
+
+public:
+  GizmoGardenStaticPixels(uint8_t pin)
+    : Strip(pin, Output ? outputBuffer : 0)
+  {}
+
+private:
+  uint8_t outputBuffer[Output ? Pixels * Strip::PixelSize : 1];
+};
+
 #endif
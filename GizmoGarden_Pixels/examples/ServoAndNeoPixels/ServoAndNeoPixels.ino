@@ -84,7 +84,10 @@ MakeGizmoGardenTask(neoTask)
   neoPixels.setPixelColor(pixelIndex, (pixelIndex & 1) << 6, (pixelIndex & 2) << 5, (pixelIndex & 4) << 4);
   neoPixels.show();
   pixelIndex = (pixelIndex + 1) % neoPixels.numPixels();
-  callMe(40);
+
+  // Come back about 40 ms from now, in the servo safe time, so that
+  // the show runs right away
+  callMeAt(GizmoGardenServo::getFrameTime(35));
 }
 
 // ****************
@@ -0,0 +1,448 @@
+/********************************************************************
+Copyright (c) 2015 Bill Silver (gizmogarden.org). This source code is
+distributed under terms of the GNU General Public License, Version 3,
+which grants certain rights to copy, modify, and redistribute. The
+license can be found at <http://www.gnu.org/licenses/>. There is no
+express or implied warranty, including merchantability or fitness for
+a particular purpose.
+********************************************************************/
+
+// ***************************
+// *                         *
+// *  NeoPixel Timing Bench  *
+// *                         *
+// ***************************
+
+// Runs PixelBenchFirmware in the simavr AVR simulator, cycle by cycle,
+// and watches the NeoPixel data pin and two servo pins. The waveform on
+// the data pin is decoded back into bytes and checked against the test
+// pattern, and every high and low time is checked against the WS2812B
+// data sheet. The bench also measures how long interrupts were off for
+// each show, and checks that no servo pulse was high while a show was
+// going on. See README.md for how to build and run it.
+//
+// Times are taken from the simulator's cycle count when the pin changes,
+// so they are exact to the CPU cycle, as an oscilloscope would see them.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "avr_ioport.h"
+
+#include "PixelBenchFirmware/PixelBenchPattern.h"
+
+// ********************
+// *                  *
+// *  WS2812B Timing  *
+// *                  *
+// ********************
+
+// From the WS2812B data sheet, in ns. High times are 400 and 800 ns
+// +/- 150 ns. Low times within a frame are 450 ns - 150 ns at the least,
+// and should stay well short of a latch; 5 us is the limit here. A low
+// time of at least 50 us latches the data and ends the frame.
+enum Timing
+{
+  T0HMin    =   250,
+  T0HMax    =   550,
+  T1HMin    =   650,
+  T1HMax    =   950,
+  BitSplit  =   600,     // high times below this are 0 bits
+  LowMin    =   300,
+  LowMax    =  5000,
+  LatchMin  = 50000,
+};
+
+// ****************
+// *              *
+// *  Board Pins  *
+// *              *
+// ****************
+
+// Where the Arduino pins in PixelBenchPattern.h are on each chip
+struct Board
+{
+  const char* name;
+  const char* mcu;
+  char  dataPort;
+  uint8_t dataBit;
+  char  servoPort[2];
+  uint8_t servoBit[2];
+};
+
+static const Board boards[] =
+{
+  { "uno",  "atmega328p", 'D', 6, { 'B', 'B' }, { 1, 0 } },
+  { "mega", "atmega2560", 'H', 3, { 'H', 'H' }, { 6, 5 } },
+};
+
+// ****************
+// *              *
+// *  Statistics  *
+// *              *
+// ****************
+
+struct MinMax
+{
+  uint32_t min, max;
+  MinMax() : min(0xFFFFFFFF), max(0) {}
+  void add(uint32_t x)
+  {
+    if (x < min) min = x;
+    if (x > max) max = x;
+  }
+  bool empty() const { return max < min; }
+};
+
+// Results for one strip length, over all the frames shown at that length
+struct LengthStats
+{
+  uint16_t shows, badTimes;
+  MinMax t0h, t1h, low, latch, intsOff;
+};
+
+static LengthStats stats[BenchLengthCount];
+
+// The frames the firmware is expected to show, in order
+struct Expected
+{
+  uint8_t lengthIndex;
+  uint8_t frame;
+};
+
+enum { ExpectedCount = BenchPasses * BenchLengthCount * BenchFrames };
+static Expected expected[ExpectedCount];
+static int expectIndex;
+static uint16_t unexpectedFrames;
+
+// *******************
+// *                 *
+// *  Data Pin Watch  *
+// *                 *
+// *******************
+
+static avr_t* avr;
+static uint32_t cyclesPerUs;
+
+static uint32_t toNs(avr_cycle_count_t cycles)
+{
+  return (uint32_t)(cycles * 1000 / cyclesPerUs);
+}
+
+// The frame being received
+struct Frame
+{
+  bool open;
+  avr_cycle_count_t start;
+  uint32_t latch;                   // low time before it, ns
+  uint32_t intsOff;                 // ns, 0 until interrupts come back on
+  uint16_t bytes;
+  uint8_t  bit;
+  uint8_t  data[3 * BenchPixelsMax];
+  MinMax   t0h, t1h, low;
+  uint16_t badTimes;
+};
+
+static Frame rx;
+
+static avr_cycle_count_t riseTime, fallTime;
+static bool dataHigh;
+static uint16_t framesSeen;
+
+// Interrupts-off tracking
+static bool intsWereOn = true;
+static avr_cycle_count_t intsOffStart;
+static bool showing;
+
+// Servo pin tracking
+static bool servoHigh[2];
+static uint32_t servoPulses[2];
+static uint16_t servoConflicts;
+
+static bool frameMatches(const Expected& e)
+{
+  uint16_t n = benchLengths[e.lengthIndex];
+  if (rx.bytes != 3 * n || rx.bit != 0)
+    return false;
+  for (uint16_t i = 0; i < n; ++i)
+    for (uint8_t k = 0; k < 3; ++k)
+      if (rx.data[3 * i + k] != benchByte(i, k, e.frame))
+        return false;
+  return true;
+}
+
+// Called at the start of the next frame, or at the end of the run. A
+// frame that matches the one expected counts for it, and may repeat;
+// one that matches the next expected moves on to it.
+static void closeFrame()
+{
+  if (!rx.open)
+    return;
+  rx.open = false;
+  ++framesSeen;
+
+  const Expected* e = 0;
+  if (expectIndex < ExpectedCount && frameMatches(expected[expectIndex]))
+    e = &expected[expectIndex];
+  else if (expectIndex + 1 < ExpectedCount && frameMatches(expected[expectIndex + 1]))
+    e = &expected[++expectIndex];
+
+  if (e == 0)
+  {
+    ++unexpectedFrames;
+    printf("  frame %u: %u bytes + %u bits not in the test pattern\n",
+           framesSeen, rx.bytes, rx.bit);
+    return;
+  }
+
+  LengthStats& ls = stats[e->lengthIndex];
+  ++ls.shows;
+  ls.badTimes += rx.badTimes;
+  if (!rx.t0h.empty()) { ls.t0h.add(rx.t0h.min); ls.t0h.add(rx.t0h.max); }
+  if (!rx.t1h.empty()) { ls.t1h.add(rx.t1h.min); ls.t1h.add(rx.t1h.max); }
+  if (!rx.low.empty()) { ls.low.add(rx.low.min); ls.low.add(rx.low.max); }
+  if (framesSeen > 1)
+    ls.latch.add(rx.latch);
+  if (rx.intsOff != 0)
+    ls.intsOff.add(rx.intsOff);
+}
+
+static void openFrame(avr_cycle_count_t t, uint32_t latch)
+{
+  closeFrame();
+  rx = Frame();
+  rx.open = true;
+  rx.start = t;
+  rx.latch = latch;
+
+  for (int s = 0; s < 2; ++s)
+    if (servoHigh[s])
+      ++servoConflicts;
+  showing = !intsWereOn;
+}
+
+static void dataPinHook(avr_irq_t*, uint32_t value, void*)
+{
+  avr_cycle_count_t t = avr->cycle;
+  if (value != 0 && !dataHigh)
+  {
+    uint32_t low = toNs(t - fallTime);
+    if (!rx.open || low >= LatchMin)
+      openFrame(t, low);
+    else
+    {
+      rx.low.add(low);
+      if (low < LowMin || low > LowMax)
+        ++rx.badTimes;
+    }
+    riseTime = t;
+    dataHigh = true;
+  }
+  else if (value == 0 && dataHigh)
+  {
+    uint32_t high = toNs(t - riseTime);
+    bool one = high >= BitSplit;
+    if (one)
+    {
+      rx.t1h.add(high);
+      if (high < T1HMin || high > T1HMax)
+        ++rx.badTimes;
+    }
+    else
+    {
+      rx.t0h.add(high);
+      if (high < T0HMin || high > T0HMax)
+        ++rx.badTimes;
+    }
+
+    if (rx.bytes < sizeof(rx.data))
+    {
+      rx.data[rx.bytes] = (uint8_t)(rx.data[rx.bytes] << 1 | one);
+      if (++rx.bit == 8)
+      {
+        rx.bit = 0;
+        ++rx.bytes;
+      }
+    }
+    fallTime = t;
+    dataHigh = false;
+  }
+}
+
+static void servoPinHook(avr_irq_t*, uint32_t value, void* param)
+{
+  int s = (int)(intptr_t)param;
+  if (value != 0 && !servoHigh[s])
+  {
+    ++servoPulses[s];
+    if (showing)
+      ++servoConflicts;
+  }
+  servoHigh[s] = value != 0;
+}
+
+// Called after every instruction. The interrupts-off time of a show runs
+// from when interrupts went off to when they came back on, and is
+// charged to the frame that started in between.
+static void watchInterrupts()
+{
+  bool on = avr->sreg[S_I] != 0;
+  if (on == intsWereOn)
+    return;
+
+  if (!on)
+    intsOffStart = avr->cycle;
+  else
+  {
+    if (rx.open && rx.intsOff == 0 && rx.start >= intsOffStart)
+      rx.intsOff = toNs(avr->cycle - intsOffStart);
+    showing = false;
+  }
+  intsWereOn = on;
+}
+
+// ***************
+// *             *
+// *  Reporting  *
+// *             *
+// ***************
+
+static void printRange(const MinMax& m, uint32_t scale)
+{
+  if (m.empty())
+    printf("      -     ");
+  else
+    printf(" %5u-%-5u", m.min / scale, m.max / scale);
+}
+
+static bool report()
+{
+  bool pass = true;
+
+  printf("pixels shows bad  T0H ns      T1H ns      low ns      latch us    ints off us  us/pixel\n");
+  for (int s = 0; s < BenchLengthCount; ++s)
+  {
+    const LengthStats& ls = stats[s];
+    printf("%6u %5u %4u", benchLengths[s], ls.shows, ls.badTimes);
+    printRange(ls.t0h, 1);
+    printRange(ls.t1h, 1);
+    printRange(ls.low, 1);
+    printRange(ls.latch, 1000);
+    printRange(ls.intsOff, 1000);
+    if (ls.intsOff.empty())
+      printf("       -\n");
+    else
+      printf("  %7.2f\n", ls.intsOff.max / 1000.0 / benchLengths[s]);
+
+    if (ls.shows == 0 || ls.badTimes != 0 || (!ls.latch.empty() && ls.latch.min < LatchMin))
+      pass = false;
+  }
+
+  printf("%u frames, %u not in the pattern, %d of %d expected frames reached\n",
+         framesSeen, unexpectedFrames, expectIndex + 1, ExpectedCount);
+  printf("servo pulses %u and %u, %u high during a show\n",
+         servoPulses[0], servoPulses[1], servoConflicts);
+
+  if (unexpectedFrames != 0 || expectIndex + 1 != ExpectedCount || servoConflicts != 0 ||
+      servoPulses[0] == 0 || servoPulses[1] == 0)
+    pass = false;
+
+  return pass;
+}
+
+// **********
+// *        *
+// *  Main  *
+// *        *
+// **********
+
+static void usage()
+{
+  printf("usage: PixelBench firmware.elf [uno | mega] [MHz]\n");
+  exit(2);
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+    usage();
+
+  const Board* board = &boards[0];
+  uint32_t mhz = 16;
+  for (int i = 2; i < argc; ++i)
+  {
+    int b;
+    for (b = 0; b < (int)(sizeof(boards) / sizeof(boards[0])); ++b)
+      if (strcmp(argv[i], boards[b].name) == 0)
+        break;
+    if (b < (int)(sizeof(boards) / sizeof(boards[0])))
+      board = &boards[b];
+    else if ((mhz = (uint32_t)atoi(argv[i])) == 0)
+      usage();
+  }
+
+  int n = 0;
+  for (int pass = 0; pass < BenchPasses; ++pass)
+    for (int s = 0; s < BenchLengthCount; ++s)
+      for (int f = 0; f < BenchFrames; ++f, ++n)
+      {
+        expected[n].lengthIndex = (uint8_t)s;
+        expected[n].frame = (uint8_t)n;
+      }
+
+  elf_firmware_t firmware;
+  memset(&firmware, 0, sizeof(firmware));
+  if (elf_read_firmware(argv[1], &firmware) != 0)
+  {
+    printf("can't read %s\n", argv[1]);
+    return 2;
+  }
+
+  avr = avr_make_mcu_by_name(board->mcu);
+  if (avr == 0)
+  {
+    printf("simavr doesn't know %s\n", board->mcu);
+    return 2;
+  }
+  avr_init(avr);
+  avr_load_firmware(avr, &firmware);
+
+  // The firmware must have been built for this clock; the bit loops in
+  // showInterrupt() are chosen by F_CPU at compile time
+  avr->frequency = mhz * 1000000;
+  cyclesPerUs = mhz;
+
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(board->dataPort),
+                                        board->dataBit),
+                          dataPinHook, 0);
+  for (int s = 0; s < 2; ++s)
+    avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(board->servoPort[s]),
+                                          board->servoBit[s]),
+                            servoPinHook, (void*)(intptr_t)s);
+
+  printf("PixelBench: %s at %u MHz, data on pin %d (P%c%u)\n",
+         board->mcu, mhz, NeoPin, board->dataPort, board->dataBit);
+
+  // The firmware sleeps with interrupts off when it is done. Ten seconds
+  // of simulated time is far more than it needs.
+  avr_cycle_count_t limit = (avr_cycle_count_t)avr->frequency * 10;
+  int state = cpu_Running;
+  while (state != cpu_Done && state != cpu_Crashed && avr->cycle < limit)
+  {
+    state = avr_run(avr);
+    watchInterrupts();
+  }
+  closeFrame();
+
+  if (state == cpu_Crashed)
+    printf("firmware crashed at cycle %llu\n", (unsigned long long)avr->cycle);
+  else if (state != cpu_Done)
+    printf("firmware didn't finish in 10 s\n");
+
+  bool pass = report() && state == cpu_Done;
+  printf(pass ? "PASS\n" : "FAIL\n");
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,90 @@
+// ******************************************
+// *                                        *
+// *  Gizmo Garden NeoPixel Bench Firmware  *
+// *                                        *
+// ******************************************
+//
+// Not a sketch to run on a real Arduino. It is loaded into the simavr
+// simulator by PixelBench, which watches the data pin and checks what
+// comes out. See ../README.md.
+//
+// The sketch shows every strip length in PixelBenchPattern.h a few times,
+// first with no servos running, so show() goes straight to
+// showInterrupt(), and then with two servos running, so the shows wait
+// for safe times in the servo frame. Each frame is shown twice in a row
+// to make the second one wait out the 50 us latch. Then the sketch turns
+// interrupts off and sleeps, which tells simavr to stop.
+
+#include <avr/sleep.h>
+
+#include <Adafruit_NeoPixel_GizmoGardenModified.h>
+
+#include <GizmoGardenPixels.h>
+#include <GizmoGardenServo.h>
+
+#include "PixelBenchPattern.h"
+
+// One object per length, all on the same pin. Each object keeps its own
+// latch time, so the delay after each frame also keeps one strip from
+// following another too closely.
+GizmoGardenPixels strip0(benchLengths[0], NeoPin);
+GizmoGardenPixels strip1(benchLengths[1], NeoPin);
+GizmoGardenPixels strip2(benchLengths[2], NeoPin);
+GizmoGardenPixels strip3(benchLengths[3], NeoPin);
+
+GizmoGardenPixels* const strips[BenchLengthCount] = { &strip0, &strip1, &strip2, &strip3 };
+
+GizmoGardenServo servoA, servoB;
+
+void setup()
+{
+  uint8_t frame = 0;
+  for (uint8_t pass = 0; pass < BenchPasses; ++pass)
+  {
+    if (pass == 1)
+    {
+      servoA.attach(ServoPinA);
+      servoB.attach(ServoPinB);
+      servoA.writeMicroseconds(1200);
+      servoB.writeMicroseconds(1800);
+      delay(50);
+    }
+
+    for (uint8_t s = 0; s < BenchLengthCount; ++s)
+    {
+      GizmoGardenPixels& strip = *strips[s];
+      strip.begin();
+      for (uint8_t f = 0; f < BenchFrames; ++f, ++frame)
+      {
+        // NEO_GRB sends green first
+        for (uint16_t i = 0; i < strip.numPixels(); ++i)
+          strip.setPixelColor(i, benchByte(i, 1, frame), benchByte(i, 0, frame),
+                              benchByte(i, 2, frame));
+
+        // show() skips a strip that hasn't changed, so mark it changed for
+        // the second one. With servos running, the second show() usually
+        // finds the first still waiting and replaces it, and there is only
+        // one show.
+        strip.show();
+        strip.pixelsChanged();
+        strip.show();
+
+        // More than a servo frame, so a waiting show gets its turn before
+        // the pixels change
+        delay(25);
+      }
+    }
+  }
+
+  servoA.detach();
+  servoB.detach();
+  delay(25);
+
+  cli();
+  sleep_enable();
+  sleep_cpu();
+}
+
+void loop()
+{
+}
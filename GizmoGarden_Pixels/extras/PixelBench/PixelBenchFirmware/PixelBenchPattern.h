@@ -0,0 +1,53 @@
+#ifndef _PixelBenchPattern_
+#define _PixelBenchPattern_
+
+/********************************************************************
+Copyright (c) 2015 Bill Silver (gizmogarden.org). This source code is
+distributed under terms of the GNU General Public License, Version 3,
+which grants certain rights to copy, modify, and redistribute. The
+license can be found at <http://www.gnu.org/licenses/>. There is no
+express or implied warranty, including merchantability or fitness for
+a particular purpose.
+********************************************************************/
+
+// ******************************
+// *                            *
+// *  Pixel Bench Test Pattern  *
+// *                            *
+// ******************************
+
+// Shared by the firmware and the bench, so that they agree on what
+// should come out of the data pin and in what order.
+
+#include <stdint.h>
+
+// Strip lengths shown, in order, in each pass
+static const uint16_t benchLengths[] = { 1, 8, 60, 144 };
+
+enum
+{
+  BenchLengthCount = sizeof(benchLengths) / sizeof(benchLengths[0]),
+  BenchFrames      = 4,     // frames shown for each length in each pass
+  BenchPasses      = 2,     // first without servos, then with two running
+  BenchPixelsMax   = 144,
+};
+
+// Arduino digital pins, the same on an Uno and a Mega. The servo pins are
+// ones the interrupt handler writes itself. Pin 10 on an Uno would be pulsed
+// by timer 1 in hardware, and the bench would depend on how simavr models a
+// forced output compare.
+enum BenchPins
+{
+  NeoPin     =  6,
+  ServoPinA  =  9,
+  ServoPinB  =  8,
+};
+
+// Byte k, in the order sent, of the given pixel of frame number frame.
+// Frames are numbered in the order shown, across lengths and passes.
+inline uint8_t benchByte(uint16_t pixel, uint8_t k, uint8_t frame)
+{
+  return (uint8_t)(pixel * 29 + k * 85 + frame * 53 + 1);
+}
+
+#endif
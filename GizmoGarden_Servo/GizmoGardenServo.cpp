@@ -61,56 +61,369 @@ public:
 // *                     *
 // ***********************
 
-// You can use a different timer by changing these macros
-#define TCNT  TCNT1
-#define OCRA  OCR1A
-#define TCCRA TCCR1A
-#define TCCRB TCCR1B
-#define TIFR  TIFR1
-#define TIMSK TIMSK1
+// Registers of each timer that can drive a servo bank. You can use
+// different timers by changing these and the bank setup below. The
+// bit positions are the same in all of the 16-bit timers, so the timer 1
+// names are used for all of them.
+#define SERVO_TIMER(n)                                        \
+struct ServoTimer##n                                          \
+{                                                             \
+  static volatile uint16_t& tcnt () { return TCNT##n;      }  \
+  static volatile uint16_t& ocra () { return OCR##n##A;    }  \
+  static volatile uint8_t&  tccra() { return TCCR##n##A;   }  \
+  static volatile uint8_t&  tccrb() { return TCCR##n##B;   }  \
+  static volatile uint8_t&  tccrc() { return TCCR##n##C;   }  \
+  static volatile uint8_t&  tifr () { return TIFR##n;      }  \
+  static volatile uint8_t&  timsk() { return TIMSK##n;     }  \
+};
+
+SERVO_TIMER(1)
+#if GIZMO_GARDEN_SERVO_BANK_COUNT > 1
+SERVO_TIMER(3)
+SERVO_TIMER(4)
+SERVO_TIMER(5)
+#endif
+
+#if GIZMO_GARDEN_SERVO_BANK_COUNT > 1
+uint16_t GizmoGardenServoBank::lastSpinEnd = 0;
+
+// Timer count of a bank, for code that doesn't know the timer at compile
+// time
+static volatile uint16_t& timerCount(uint8_t bank)
+{
+  switch (bank)
+  {
+  case 1: return ServoTimer3::tcnt();
+  case 2: return ServoTimer4::tcnt();
+  case 3: return ServoTimer5::tcnt();
+  }
+  return ServoTimer1::tcnt();
+}
+
+// A handler can't be interrupted, so one that spins past the trailing edge
+// of another bank makes it late, by as much as the margin or, when it
+// services several edges of its group in a row, even more. So before
+// spinning for an edge, the handler ends the pulses of other banks that
+// are due first, in order. Their own interrupts come later and find those
+// edges done. The edges are put in order on Timer 1, the common clock, but
+// each is timed on its own timer, which is exact.
+void GizmoGardenServoBank::endEarlierPulses(uint16_t due)
+{
+  for (;;)
+  {
+    uint8_t first = GizmoGardenServo::Banks;
+    uint16_t firstDue = due;
+    for (uint8_t b = 0; b < GizmoGardenServo::Banks; ++b)
+    {
+      GizmoGardenServoBank& other = GizmoGardenServo::banks[b];
+      if (&other == this || other.groupIndex >= other.groupCount)
+        continue;
+      uint16_t d = other.group[other.groupIndex]->pulseEnd + other.clockOffset;
+      if ((int16_t)(d - firstDue) < 0)
+      {
+        first = b;
+        firstDue = d;
+      }
+    }
+    if (first == GizmoGardenServo::Banks)
+      return;
+
+    GizmoGardenServoBank& other = GizmoGardenServo::banks[first];
+    GizmoGardenServo* s = other.group[other.groupIndex++];
+    while ((int16_t)(timerCount(first) - s->pulseEnd) < 0);
+    *s->outputRegister &= ~s->pinMask;
+    lastSpinEnd = firstDue;
+  }
+}
+#endif
+
+// Timer control register A of a bank, for code that doesn't know the
+// timer at compile time
+#if GIZMO_GARDEN_SERVO_BANK_COUNT > 1
+static volatile uint8_t& timerControl(uint8_t bank)
+{
+  switch (bank)
+  {
+  case 1: return ServoTimer3::tccra();
+  case 2: return ServoTimer4::tccra();
+  case 3: return ServoTimer5::tccra();
+  }
+  return ServoTimer1::tccra();
+}
+#else
+static volatile uint8_t& timerControl(uint8_t)
+{
+  return ServoTimer1::tccra();
+}
+#endif
+
+// The output-compare registers of a timer follow each other, A then B
+// then C, and the compare output mode bits of each channel are two below
+// those of the one before. The pin goes high on the forced compare match,
+// and the timer clears it at the real one.
+template<class Timer>
+inline void GizmoGardenServoBank::startHardware(GizmoGardenServo* s, uint8_t channel)
+{
+  uint8_t com = COM1A0 - 2 * channel;
+  bool enabled = s->isEnabled();
+  if (!enabled || !s->awake())
+  {
+    if (enabled)
+      ++GizmoGardenServo::idlePulses;
+    Timer::tccra() &= ~(3 << com);
+    return;
+  }
 
-inline void GizmoGardenServo::interruptHandler()
+  Timer::tccra() |= 3 << com;               // set on compare match
+  Timer::tccrc() = _BV(FOC1A - channel);    // force a match
+  (&Timer::ocra())[channel] = Timer::tcnt() + s->pulseTicks;
+  Timer::tccra() &= ~_BV(com);              // clear on compare match
+}
+
+template<class Timer>
+inline void GizmoGardenServoBank::interruptHandler()
 {
-  if (current == 0)
+  if (!inFrame())
   {
-    TCNT = 0;
+#if GIZMO_GARDEN_SERVO_BANK_COUNT > 1
+    // Timer 1 is the common clock of the banks, so when it starts over,
+    // the times the others have on it move back with it.
+    if (this == GizmoGardenServo::banks)
+    {
+      uint16_t restart = Timer::tcnt();
+      for (uint8_t b = 1; b < GizmoGardenServo::Banks; ++b)
+        GizmoGardenServo::banks[b].clockOffset -= restart;
+      lastSpinEnd -= restart;
+    }
+#endif
+    Timer::tcnt() = 0;
     current = servoList;
+
+    if (this == GizmoGardenServo::banks)
+    {
+      GizmoGardenServo::frameStart = millis();
+      if (GizmoGardenServo::commitPending && !GizmoGardenServo::copying)
+        GizmoGardenServo::commit();
+    }
+
+#if GIZMO_GARDEN_SERVO_BANK_COUNT > 1
+    // Bank 0 keeps the frames of the other banks in step with its own,
+    // so that their safe times overlap.
+    if (this == GizmoGardenServo::banks)
+    {
+      uint16_t stagger = GizmoGardenServo::usToTicks(BankStagger);
+      GizmoGardenServo::banks[1].startFrame<ServoTimer3>(stagger);
+      GizmoGardenServo::banks[2].startFrame<ServoTimer4>(2 * stagger);
+      GizmoGardenServo::banks[3].startFrame<ServoTimer5>(3 * stagger);
+    }
+#endif
+
+    // Motion profiles step here rather than at the end of the last frame,
+    // where other banks may still have pulses going. A late start of the
+    // first group costs nothing, and the new widths are used right away.
+    if (GizmoGardenServo::profiles != 0)
+      for (GizmoGardenServo* s = servoList; s != 0; s = s->next)
+        if (s->maxSpeed != 0)
+          s->stepMotion();
+
+    for (uint8_t c = 0; c < 2; ++c)
+      if (hardware[c] != 0)
+        startHardware<Timer>(hardware[c], c + 1);
   }
   else
   {
-    while (TCNT < current->pulseEnd);
-    digitalWrite(current->pin, LOW);
-    current = current->next;
-  }
+    // Service the trailing edges of the current group in order. Any that
+    // are too close to schedule another interrupt are done now.
+    uint16_t scheduled = Timer::ocra();
+    uint16_t entry = Timer::tcnt();
+    uint16_t t = entry;
+#if GIZMO_GARDEN_SERVO_BANK_COUNT > 1
+    uint8_t first = groupIndex;
+#endif
+    bool waiting = false;
+    while (groupIndex < groupCount)
+    {
+      GizmoGardenServo* s = group[groupIndex];
+      uint16_t early = s->pulseEnd - margin;
+      if (early > t + 4)
+      {
+        Timer::ocra() = early;
+        waiting = true;
+        break;
+      }
+#if GIZMO_GARDEN_SERVO_BANK_COUNT > 1
+      endEarlierPulses(s->pulseEnd + clockOffset);
+#endif
+      while (Timer::tcnt() < s->pulseEnd);
+      *s->outputRegister &= ~s->pinMask;
+      ++groupIndex;
+      if ((int16_t)(s->pulseEnd - t) > 0)
+        spinTicks += s->pulseEnd - t;
+      t = Timer::tcnt();
+    }
 
-  for (; current != 0; current = current->next)
-    if (current->isEnabled())
+    // Now that the edges are done, measure how late this interrupt was
+    // compared to when it was scheduled.
+    int16_t late = entry - scheduled;
+#if GIZMO_GARDEN_SERVO_BANK_COUNT > 1
+    // Time spent waiting for another bank to spin-wait doesn't count. It
+    // ended any edges of this bank that came first, so nothing was late,
+    // and the banks would otherwise feed each other's margins until all
+    // hit MaxJitterMargin.
+    int16_t sinceSpin = entry + clockOffset - lastSpinEnd;
+    if (sinceSpin < late)
+      late = sinceSpin;
+    if (groupIndex != first)
+      lastSpinEnd = group[groupIndex - 1]->pulseEnd + clockOffset;
+#endif
+    if (late > lateMax)
     {
-      current->pulseEnd = TCNT + current->pulseTicks + TrimTicks;
-      OCRA = current->pulseEnd - usToTicks(JitterMargin);
-      digitalWrite(current->pin, HIGH);
+      lateMax = (uint8_t)min(late, (int16_t)255);
+      setMargin();
+    }
+
+    if (waiting)
       return;
+  }
+
+#if GIZMO_GARDEN_SERVO_BANK_COUNT > 1
+  // A late leading edge costs nothing, so end any pulses of other banks
+  // whose interrupts are due before starting the next group.
+  endEarlierPulses(ServoTimer1::tcnt() + margin);
+#endif
+
+  // Collect the next group, sorted by pulse duration so that the trailing
+  // edges come in order. The group members are started in that order,
+  // each right after reading the timer, so the pulse ends stay in order.
+  groupCount = groupIndex = 0;
+  for (; current != 0 && groupCount < GizmoGardenServo::groupSize; current = current->next)
+    if (current->isEnabled() && current->channel == 0)
+    {
+      if (!current->awake())
+      {
+        ++GizmoGardenServo::idlePulses;
+        GizmoGardenServo::idleCycles += IdlePulseCycles + 8 * margin;
+        continue;
+      }
+
+      uint8_t i = groupCount++;
+      for (; i > 0 && group[i - 1]->pulseTicks > current->pulseTicks; --i)
+        group[i] = group[i - 1];
+      group[i] = current;
+    }
+
+  if (groupCount > 0)
+  {
+#if GIZMO_GARDEN_SERVO_BANK_COUNT > 1
+    clockOffset = ServoTimer1::tcnt() - Timer::tcnt();
+#endif
+    for (uint8_t i = 0; i < groupCount; ++i)
+    {
+      GizmoGardenServo* s = group[i];
+      uint16_t t = Timer::tcnt();
+      *s->outputRegister |= s->pinMask;
+      s->pulseEnd = t + s->pulseTicks + TrimTicks;
     }
+    Timer::ocra() = group[0]->pulseEnd - margin;
+    return;
+  }
 
-  OCRA = max(usToTicks(RefreshInterval), TCNT + 4);
+  endFrame();
 
-  for (ServoCallback* sc = ServoCallback::list; sc != 0; sc = sc->next)
-    if (sc->callbackScheduled)
+  // The frame of this bank is over. Bank 0 will normally start the next
+  // one before this time comes around.
+  Timer::ocra() = max(refresh(), (uint16_t)(Timer::tcnt() + 4));
+
+  if (GizmoGardenServo::inFrame())
+    return;
+
+  ServoCallback::runScheduled();
+}
+
+// The margin covers the highest lateness seen, or the floor set by
+// setMinLatency if that is more, plus the guard time, within bounds.
+// Interrupts off hold up every bank alike, so all banks share one margin.
+uint8_t GizmoGardenServoBank::margin = 0;
+uint8_t GizmoGardenServoBank::lateMax = 0;
+uint8_t GizmoGardenServoBank::minLate = 0;
+uint8_t GizmoGardenServoBank::decayCount = 0;
+
+void GizmoGardenServoBank::setMargin()
+{
+  uint8_t late = max(lateMax, minLate);
+  margin = (uint8_t)constrain(late + GizmoGardenServo::usToTicks(JitterGuard),
+                              GizmoGardenServo::usToTicks(MinJitterMargin),
+                              GizmoGardenServo::usToTicks(MaxJitterMargin));
+}
+
+// The high-water mark leaks away one tick every MarginDecayFrames frames
+// of bank 0, so the margin shrinks slowly after the interference that
+// raised it goes away.
+void GizmoGardenServoBank::endFrame()
+{
+  frameSpin = spinTicks;
+  spinTicks = 0;
+
+  if (this == GizmoGardenServo::banks && ++decayCount >= MarginDecayFrames)
+  {
+    decayCount = 0;
+    if (lateMax > 0)
     {
-      sc->callback();
-      sc->callbackScheduled = false;
+      --lateMax;
+      setMargin();
     }
+  }
+}
+
+// Called from bank 0's interrupt handler at the start of its frame. If
+// this bank has the same refresh interval as bank 0, is done with its
+// frame, and at least half the interval has gone by, start the next
+// frame after the specified delay in ticks. A bank with its own rate
+// keeps its own time.
+template<class Timer>
+inline void GizmoGardenServoBank::startFrame(uint16_t delay)
+{
+  uint16_t interval = refresh();
+  if (interval != GizmoGardenServo::banks[0].refresh())
+    return;
+
+  uint16_t t = Timer::tcnt();
+  if (!inFrame() && t > interval / 2)
+    Timer::ocra() = t + 4 + delay;
+}
+
+template<uint8_t bank, class Timer>
+void GizmoGardenServo::interruptHandler()
+{
+  banks[bank].interruptHandler<Timer>();
 }
 
 #ifndef WIRING
 SIGNAL(TIMER1_COMPA_vect)
 {
-  GizmoGardenServo::interruptHandler();
+  GizmoGardenServo::interruptHandler<0, ServoTimer1>();
 }
+
+#if GIZMO_GARDEN_SERVO_BANK_COUNT > 1
+SIGNAL(TIMER3_COMPA_vect)
+{
+  GizmoGardenServo::interruptHandler<1, ServoTimer3>();
+}
+
+SIGNAL(TIMER4_COMPA_vect)
+{
+  GizmoGardenServo::interruptHandler<2, ServoTimer4>();
+}
+
+SIGNAL(TIMER5_COMPA_vect)
+{
+  GizmoGardenServo::interruptHandler<3, ServoTimer5>();
+}
+#endif
 #else
 void Timer1Service()
 {
-  GizmoGardenServo::interruptHandler();
+  GizmoGardenServo::interruptHandler<0, ServoTimer1>();
 }
 #endif
 
@@ -121,6 +434,8 @@ void Timer1Service()
 // *******************
 
 ServoCallback* ServoCallback::list = 0;
+uint16_t ServoCallback::safeTimeSpent = 0;
+ServoCallback* ServoCallback::resume = 0;
 
 ServoCallback::ServoCallback()
 : next(list), callbackScheduled(false)
@@ -138,30 +453,107 @@ ServoCallback::~ServoCallback()
     q->next = next;
   else
     list = next;
+  if (resume == this)
+    resume = 0;
 }
 
+// True if a callback of the given time fits in what is left of the
+// current safe time, and if so count it as spent. Nothing spent yet
+// means it fits, however long.
+bool ServoCallback::fits(uint16_t time)
+{
+  if (safeTimeSpent != 0 &&
+      (safeTimeSpent >= SafeTimeBudget || time > SafeTimeBudget - safeTimeSpent))
+    return false;
+  safeTimeSpent += min(time, (uint16_t)SafeTimeBudget);
+  return true;
+}
+
+// Before the servos have started, there are no safe times to share.
 void ServoCallback::call()
 {
   IntOffBlock iof;
-  if (GizmoGardenServo::current == 0)
+  if (!GizmoGardenServo::inFrame() &&
+      ((ServoTimer1::timsk() & _BV(OCIE1A)) == 0 || fits(callbackTime())))
     callback();
   else
     callbackScheduled = true;
 }
 
+// Called at point D of the last bank, with interrupts off. Goes once
+// around the list, starting with the one left waiting last time, and runs
+// the scheduled callbacks that fit. The first of those left waiting this
+// time goes first next time.
+void ServoCallback::runScheduled()
+{
+  safeTimeSpent = 0;
+  if (list == 0)
+    return;
+
+  ServoCallback* start = resume != 0 ? resume : list;
+  ServoCallback* waiting = 0;
+  ServoCallback* sc = start;
+  do
+  {
+    if (sc->callbackScheduled)
+    {
+      if (fits(sc->callbackTime()))
+      {
+        sc->callback();
+        sc->callbackScheduled = false;
+      }
+      else if (waiting == 0)
+        waiting = sc;
+    }
+    sc = sc->next != 0 ? sc->next : list;
+  }
+  while (sc != start);
+
+  resume = waiting;
+}
+
+bool ServoCallback::cancel()
+{
+  IntOffBlock iof;
+  bool pending = callbackScheduled;
+  callbackScheduled = false;
+  return pending;
+}
+
 // **************************
 // *                        *
 // *  Timer Initialization  *
 // *                        *
 // **************************
 
+template<class Timer>
+void GizmoGardenServoBank::begin(uint16_t start)
+{
+  Timer::tccra() = 0;             // normal counting mode
+  Timer::tccrb() = _BV(CS11);     // set prescaler to 8
+  Timer::tcnt()  = 0;             // clear the timer count
+  Timer::ocra()  = start;         // start the first frame
+  Timer::tifr() |= _BV(OCF1A);    // clear any pending interrupts
+  Timer::timsk()|= _BV(OCIE1A);   // enable output compare interrupt
+}
+
+// All banks start together, so that their frames are in step from the
+// beginning.
 void GizmoGardenServo::begin()
 {
-  TCCRA = 0;             // normal counting mode
-  TCCRB = _BV(CS11);     // set prescaler to 8
-  TCNT  = 0;             // clear the timer count
-  TIFR |= _BV(OCF1A);    // clear any pending interrupts
-  TIMSK|= _BV(OCIE1A);   // enable output compare interrupt
+  IntOffBlock iof;
+  // Start at JitterMargin, or higher if setMinLatency asks for it
+  GizmoGardenServoBank::setMargin();
+  uint8_t start = (uint8_t)usToTicks(JitterMargin);
+  if (GizmoGardenServoBank::margin < start)
+    GizmoGardenServoBank::margin = start;
+  banks[0].begin<ServoTimer1>(4);
+#if GIZMO_GARDEN_SERVO_BANK_COUNT > 1
+  uint16_t stagger = usToTicks(BankStagger);
+  banks[1].begin<ServoTimer3>(4 + stagger);
+  banks[2].begin<ServoTimer4>(4 + 2 * stagger);
+  banks[3].begin<ServoTimer5>(4 + 3 * stagger);
+#endif
 
 #if defined(WIRING)
   timerAttach(TIMER1OUTCOMPAREA_INT, Timer1Service);
@@ -174,49 +566,225 @@ void GizmoGardenServo::begin()
 // *                              *
 // ********************************
 
-GizmoGardenServo* GizmoGardenServo::servoList = 0;
-GizmoGardenServo* GizmoGardenServo::current = 0;
+// The banks have no constructor, and so are zero at startup no matter
+// what order the global servos are constructed in.
+GizmoGardenServoBank GizmoGardenServo::banks[Banks];
+uint8_t GizmoGardenServo::groupSize = 1;
 
-GizmoGardenServo::GizmoGardenServo(int pin, int minPulseTime, int maxPulseTime)
+// Timers of the output-compare pins that can pulse servos in each bank
+static const uint8_t hardwareTimers[][2] =
 {
-  init(pin, minPulseTime, maxPulseTime);
-  writeMicroseconds(DefaultPulseTime);
+  { TIMER1B, TIMER1C },
+#if GIZMO_GARDEN_SERVO_BANK_COUNT > 1
+  { TIMER3B, TIMER3C },
+  { TIMER4B, TIMER4C },
+  { TIMER5B, TIMER5C },
+#endif
+};
+
+void GizmoGardenServoBank::add(GizmoGardenServo* servo)
+{
+  servo->channel = 0;
+  if (servo->pin != -1)
+  {
+    uint8_t timer = digitalPinToTimer(servo->pin & 0x7F);
+    const uint8_t* timers = hardwareTimers[this - GizmoGardenServo::banks];
+    for (uint8_t c = 0; c < 2; ++c)
+      if (timer == timers[c] && hardware[c] == 0)
+      {
+        servo->channel = c + 1;
+        break;
+      }
+  }
 
-  next = 0;
+  servo->next = 0;
   GizmoGardenServo* q = 0;
   for (GizmoGardenServo* p = servoList; p != 0; q = p, p = p->next);
 
-  {
-    IntOffBlock iof;
-    if (q != 0)
-      q->next = this;
-    else
-      servoList = this;
-  }
+  IntOffBlock iof;
+  if (q != 0)
+    q->next = servo;
+  else
+    servoList = servo;
+  if (servo->channel != 0)
+    hardware[servo->channel - 1] = servo;
 }
 
-GizmoGardenServo::~GizmoGardenServo()
+void GizmoGardenServoBank::remove(GizmoGardenServo* servo)
 {
   GizmoGardenServo* q = 0;
   for (GizmoGardenServo* p = servoList; p != 0; q = p, p = p->next)
-    if (p == this)
+    if (p == servo)
     {
       IntOffBlock iof;
       if (q != 0)
-      {
-        q->next = next;
-        if (current == this)
-          current = q;
-      }
+        q->next = servo->next;
       else
+        servoList = servo->next;
+      if (current == servo)
+        current = servo->next;
+
+      // Give a hardware pin back to the port
+      if (servo->channel != 0)
       {
-        servoList = next;
-        if (current == this)
-          current = 0;
+        hardware[servo->channel - 1] = 0;
+        timerControl(this - GizmoGardenServo::banks) &= ~(3 << (COM1A0 - 2 * servo->channel));
+        servo->channel = 0;
       }
+
+      // If in the middle of a pulse, end it and leave the group
+      for (uint8_t i = groupIndex; i < groupCount; ++i)
+        if (group[i] == servo)
+        {
+          *servo->outputRegister &= ~servo->pinMask;
+          for (; i + 1 < groupCount; ++i)
+            group[i] = group[i + 1];
+          --groupCount;
+          break;
+        }
+      break;
     }
 }
 
+GizmoGardenServo::GizmoGardenServo(int pin, int minPulseTime, int maxPulseTime,
+                                   uint8_t bank)
+{
+  init(pin, minPulseTime, maxPulseTime);
+  pulseTicks = usToTicks(constrain((uint16_t)DefaultPulseTime, minPulse(), maxPulse()));
+  stagedTicks = pendingTicks = 0;
+  maxSpeed = 0;
+  idleFrames = quietFrames = 0;
+
+  this->bank = bank < Banks ? bank : 0;
+  banks[this->bank].add(this);
+}
+
+GizmoGardenServo::~GizmoGardenServo()
+{
+  banks[bank].remove(this);
+  if (maxSpeed != 0)
+    --profiles;
+}
+
+bool GizmoGardenServo::inFrame()
+{
+  for (uint8_t i = 0; i < Banks; ++i)
+    if (banks[i].inFrame())
+      return true;
+  return false;
+}
+
+volatile uint32_t GizmoGardenServo::frameStart = 0;
+
+// Microseconds from point A of bank 0 to the latest point D of the banks
+// that keep step with it, if every servo pulse were as long as its
+// maximum. Each group takes as long as its longest pulse.
+uint32_t GizmoGardenServo::longestFrame()
+{
+  uint16_t interval = banks[0].refresh();
+  uint32_t longest = 0;
+  for (uint8_t b = 0; b < Banks; ++b)
+  {
+    if (banks[b].refresh() != interval)
+      continue;
+
+    uint32_t us = b * (uint32_t)BankStagger;
+    uint8_t n = 0;
+    uint16_t groupMax = 0;
+    for (GizmoGardenServo* s = banks[b].servoList; s != 0; s = s->next)
+      if (s->isEnabled() && s->channel == 0)
+      {
+        groupMax = max(groupMax, s->maxPulse());
+        if (++n == groupSize)
+        {
+          us += groupMax;
+          n = 0;
+          groupMax = 0;
+        }
+      }
+    us += groupMax;
+    longest = max(longest, us);
+  }
+  return longest;
+}
+
+// Bank 0 starts frames its refresh interval apart, unless the pulses
+// don't fit, so point A is known ahead of time, and D is no later than A
+// plus the longest frame. millis() at A may be up to a millisecond behind
+// the real time. Before the servos have started, any time is safe.
+uint32_t GizmoGardenServo::getFrameTime(uint16_t wait, uint8_t offset)
+{
+  uint32_t now = millis() + wait;
+  if ((ServoTimer1::timsk() & _BV(OCIE1A)) == 0)
+    return now + offset;
+
+  uint32_t a;
+  {
+    IntOffBlock iof;
+    a = frameStart;
+  }
+  uint32_t toD = longestFrame();
+  uint32_t frame = max((uint32_t)ticksToUs(banks[0].refresh()), toD);
+
+  // The first frame whose D, rounded up to a whole millisecond after the
+  // millisecond of A, is no earlier than now
+  uint32_t frames = 0;
+  uint32_t since = (now - a) * 1000;
+  if (since >= toD + 2000)
+    frames = (since - 2000 - toD) / frame + 1;
+  return a + (frames * frame + toD + 999) / 1000 + 1 + offset;
+}
+
+void GizmoGardenServo::setRefreshInterval(uint16_t us, uint8_t bank)
+{
+  if (bank >= Banks)
+    return;
+
+  us = constrain(us, (uint16_t)MinRefreshInterval, (uint16_t)MaxRefreshInterval);
+  IntOffBlock iof;
+  banks[bank].refreshTicks = usToTicks(us);
+}
+
+uint16_t GizmoGardenServo::getRefreshInterval(uint8_t bank)
+{
+  return bank < Banks ? ticksToUs(banks[bank].refresh()) : 0;
+}
+
+uint16_t GizmoGardenServo::getJitterMargin()
+{
+  return ticksToUs(GizmoGardenServoBank::margin);
+}
+
+uint16_t GizmoGardenServo::getLatency()
+{
+  return ticksToUs(GizmoGardenServoBank::lateMax);
+}
+
+void GizmoGardenServo::setMinLatency(uint16_t us)
+{
+  IntOffBlock iof;
+  GizmoGardenServoBank::minLate = (uint8_t)min(usToTicks(us), (uint16_t)255);
+  GizmoGardenServoBank::setMargin();
+}
+
+uint16_t GizmoGardenServo::getSpinTime(uint8_t bank)
+{
+  if (bank >= Banks)
+    return 0;
+
+  uint16_t ticks;
+  {
+    IntOffBlock iof;
+    ticks = banks[bank].frameSpin;
+  }
+  return ticksToUs(ticks);
+}
+
+void GizmoGardenServo::setGroupSize(uint8_t n)
+{
+  groupSize = constrain(n, (uint8_t)1, (uint8_t)MaxGroupSize);
+}
+
 void GizmoGardenServo::init(int pin, int minTime, int maxTime)
 {
   this->pin = (int8_t)pin;
@@ -224,7 +792,11 @@ void GizmoGardenServo::init(int pin, int minTime, int maxTime)
   maxPulse(maxTime);
 
   if (this->pin != -1)
+  {
     pinMode(pin & 0x7F, OUTPUT);
+    outputRegister = portOutputRegister(digitalPinToPort(pin & 0x7F));
+    pinMask = digitalPinToBitMask(pin & 0x7F);
+  }
 }
 
 void GizmoGardenServo::enable(bool enabled)
@@ -251,9 +823,13 @@ void GizmoGardenServo::write(int value)
 void GizmoGardenServo::writeMicroseconds(int value)
 {
   uint16_t ticks = usToTicks(constrain(value, minPulse(), maxPulse()));
+  if (updateDepth > 0)
+    stagedTicks = ticks;
+  else
   {
     IntOffBlock iof;
-    pulseTicks = ticks;
+    setTicks(ticks);
+    stagedTicks = pendingTicks = 0;
   }
 }
 
@@ -264,7 +840,195 @@ int GizmoGardenServo::read()
 
 int GizmoGardenServo::readMicroseconds()
 {
-  return ticksToUs(pulseTicks);
+  uint16_t ticks;
+  {
+    IntOffBlock iof;
+    ticks = stagedTicks  != 0 ? stagedTicks  :
+            pendingTicks != 0 ? pendingTicks :
+            maxSpeed     != 0 ? targetTicks  : pulseTicks;
+  }
+  return ticksToUs(ticks);
+}
+
+// *********************
+// *                   *
+// *  Batched Updates  *
+// *                   *
+// *********************
+
+uint8_t GizmoGardenServo::updateDepth = 0;
+volatile bool GizmoGardenServo::copying = false;
+volatile bool GizmoGardenServo::commitPending = false;
+
+void GizmoGardenServo::beginUpdate()
+{
+  ++updateDepth;
+}
+
+// If the last update hasn't been committed yet, this one joins it, and
+// both take effect in the same frame. Before the servos have started there
+// is no frame to wait for, so the update is committed right away.
+void GizmoGardenServo::endUpdate()
+{
+  if (updateDepth == 0 || --updateDepth > 0)
+    return;
+
+  copying = true;
+  for (uint8_t b = 0; b < Banks; ++b)
+    for (GizmoGardenServo* s = banks[b].servoList; s != 0; s = s->next)
+      if (s->stagedTicks != 0)
+      {
+        s->pendingTicks = s->stagedTicks;
+        s->stagedTicks = 0;
+      }
+  copying = false;
+
+  if ((ServoTimer1::timsk() & _BV(OCIE1A)) == 0)
+  {
+    IntOffBlock iof;
+    commit();
+  }
+  else
+    commitPending = true;
+}
+
+// Called from bank 0's interrupt handler at the start of its frame. The
+// other banks start their frames after this, so all pending settings take
+// effect in the same frame.
+void GizmoGardenServo::commit()
+{
+  for (uint8_t b = 0; b < Banks; ++b)
+    for (GizmoGardenServo* s = banks[b].servoList; s != 0; s = s->next)
+      if (s->pendingTicks != 0)
+      {
+        s->setTicks(s->pendingTicks);
+        s->pendingTicks = 0;
+      }
+  commitPending = false;
+}
+
+// *********************
+// *                   *
+// *  Motion Profiles  *
+// *                   *
+// *********************
+
+uint8_t GizmoGardenServo::profiles = 0;
+
+// The profile works in sixteenths of a tick per frame, and per frame per
+// frame, at the refresh interval of the bank. The arithmetic is ordered
+// to stay within 32 bits for any arguments.
+void GizmoGardenServo::setMotion(uint16_t speed, uint16_t accel)
+{
+  const uint32_t usPerStep = 1000000L / (16 * usToTicks(1));
+  uint32_t frame = ticksToUs(banks[bank].refresh());
+  uint32_t speedSteps = speed * frame / usPerStep;
+  uint32_t accelSteps = accel * frame / usPerStep * frame / 1000000L;
+
+  uint16_t newSpeed = speed != 0 ? (uint16_t)constrain(speedSteps, 1UL, 16UL * 255) : 0;
+  uint8_t newAccel = accel != 0 ? (uint8_t)constrain(accelSteps, 1UL, 255UL) : 0;
+
+  IntOffBlock iof;
+  if (newSpeed != 0 && maxSpeed == 0)
+  {
+    targetTicks = pulseTicks;
+    velocity = 0;
+    fraction = 0;
+    ++profiles;
+  }
+  else if (newSpeed == 0 && maxSpeed != 0)
+  {
+    pulseTicks = targetTicks;
+    --profiles;
+  }
+  maxSpeed = newSpeed;
+  acceleration = newAccel;
+}
+
+bool GizmoGardenServo::isMoving()
+{
+  IntOffBlock iof;
+  return maxSpeed != 0 && (pulseTicks != targetTicks || fraction != 0 || velocity != 0);
+}
+
+// Called from the interrupt handler once per frame. Braking starts when
+// the distance left is within the stopping distance v*v/2a, compared
+// without dividing. Coming in, the speed doesn't drop below one step of
+// acceleration, so the pulse width gets to the target instead of
+// creeping up on it.
+void GizmoGardenServo::stepMotion()
+{
+  int32_t left = 16L * (int16_t)(targetTicks - pulseTicks) - fraction;
+  if (left == 0 && velocity == 0)
+    return;
+  quietFrames = 0;
+
+  // Work with distance and speed toward the target
+  bool up = left >= 0;
+  uint32_t distance = up ? left : -left;
+  int16_t v = up ? velocity : -velocity;
+
+  if (acceleration == 0)
+    v = maxSpeed;
+  else if (v < 0)
+    v += acceleration;
+  else if ((uint32_t)v * v > 2UL * acceleration * distance)
+    v = max((int16_t)(v - acceleration), (int16_t)acceleration);
+  else
+    v = min((int16_t)(v + acceleration), (int16_t)maxSpeed);
+
+  if (v >= 0 && (uint32_t)v >= distance)
+  {
+    pulseTicks = targetTicks;
+    fraction = 0;
+    velocity = 0;
+    return;
+  }
+
+  velocity = up ? v : -v;
+  int16_t total = fraction + velocity;
+  pulseTicks += total >> 4;
+  fraction = (uint8_t)(total & 15);
+}
+
+// *****************
+// *               *
+// *  Idle Servos  *
+// *               *
+// *****************
+
+uint32_t GizmoGardenServo::idlePulses = 0;
+uint32_t GizmoGardenServo::idleCycles = 0;
+
+void GizmoGardenServo::setIdleFrames(uint8_t frames)
+{
+  IntOffBlock iof;
+  idleFrames = frames;
+  quietFrames = 0;
+}
+
+// A skipped software pulse saves a trailing-edge interrupt, a share of
+// the group start, and a spin-wait of about the margin, at 8 CPU cycles
+// per timer tick. A skipped hardware pulse saves next to nothing.
+void GizmoGardenServo::getIdleSavings(uint16_t& pulsesPerSecond, uint32_t& cyclesPerSecond)
+{
+  static uint32_t lastTime = 0;
+
+  uint32_t pulses, cycles;
+  {
+    IntOffBlock iof;
+    pulses = idlePulses;
+    cycles = idleCycles;
+    idlePulses = 0;
+    idleCycles = 0;
+  }
+
+  uint32_t now = millis();
+  uint32_t ms = max(now - lastTime, (uint32_t)1);
+  lastTime = now;
+
+  pulsesPerSecond = (uint16_t)min(pulses * 1000 / ms, (uint32_t)65535);
+  cyclesPerSecond = cycles < 4000000UL ? cycles * 1000 / ms : cycles / ms * 1000;
 }
 
 // ***********************
@@ -273,9 +1037,17 @@ int GizmoGardenServo::readMicroseconds()
 // *                     *
 // ***********************
 
-void GizmoGardenServo::attach(int pin, int minPulseTime, int maxPulseTime)
+void GizmoGardenServo::attach(int pin, int minPulseTime, int maxPulseTime, uint8_t bank)
 {
+  // Leave the bank and join again, in case the pin is now one that can be
+  // pulsed by the timer, or no longer is
+  if (bank >= Banks)
+    bank = 0;
+  banks[this->bank].remove(this);
   init(pin, minPulseTime, maxPulseTime);
-  if ((TIMSK & _BV(OCIE1A)) == 0)
+  this->bank = bank;
+  banks[bank].add(this);
+
+  if ((ServoTimer1::timsk() & _BV(OCIE1A)) == 0)
     begin();
 }
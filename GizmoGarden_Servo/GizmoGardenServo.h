@@ -12,9 +12,10 @@ a particular purpose.
 
 /*
 This is a jitter-free software-interrupt based servo controller. It uses
-timer 1 and can control up to a dozen servos on any digital pins. It
-presents a client interface that is compatible with the standard Arduino-
-supplied servo library, as well as a new interface that is perhaps more
+timer 1 and can control up to a dozen servos on any digital pins, or
+more with group mode or the extra timers of a Mega. It presents a
+client interface that is compatible with the standard Arduino-supplied
+servo library, as well as a new interface that is perhaps more
 sensible. Servos can be controlled even in the presence of software that
 keeps interrupts off for extended periods of time, such as Adafruit
 NeoPixels.
@@ -63,8 +64,23 @@ by JitterMargin.
 The spin-wait obviously makes the servo interrupt handler run slightly
 longer, but doesn't increase the overall interrupt latency of the
 system because JitterMargin can be adjusted to match the longest of
-such events. But why bother, 25 microseconds seems to be fine and
-is no big deal.
+such events. The margin adapts to do just that. Each trailing-edge
+interrupt measures how late it arrived, and the margin follows the
+highest lateness seen plus a little guard time, within the bounds
+MinJitterMargin and MaxJitterMargin. It grows right away, and shrinks
+slowly as the high-water mark leaks away, one timer tick every
+MarginDecayFrames frames. JitterMargin is just the starting point. A
+sketch with nothing else turning interrupts off spends far less time
+spinning than a fixed 25 microseconds would cost, and one with a long
+interrupt handler gets the margin it needs. The current margin, the
+lateness high-water mark, and the spin time of the last frame can be
+read to see what it is costing. All banks share one margin.
+
+The margin only grows after a pulse has already been late, and then
+leaks back down, so an interrupt handler that is known to run longer
+than MinJitterMargin, such as that of GizmoGardenSynth, would make a
+pulse late again every so often. setMinLatency tells the margin to
+cover at least that much lateness all the time, as if it had been seen.
 
 Long-duration events can safely run with interrupts off if they do so
 in the time between D and A in the above example. Point A can be delayed by
@@ -80,7 +96,130 @@ not, callback will be called in the interrupt handler at the next point
 D.
 
 Note that there can be as many instances of classes using ServoCallback
-as you need.
+as you need. If several are waiting at point D, together they could keep
+interrupts off for longer than is safe. A ServoCallback that overrides
+callbackTime to say how long it will take is run only if it fits in what
+is left of the SafeTimeBudget of the current safe time; otherwise it
+waits for the next one. Callbacks that don't say count as taking no time.
+The first callback of a safe time always runs, however long it is, so
+none can wait forever, and each safe time starts with the first one left
+waiting by the previous safe time, so all get their turn.
+
+Group Mode
+----------
+Pulsing one servo at a time, a dozen servos at up to 2.4 ms each use up
+the whole refresh interval, leaving little time between D and A. With
+setGroupSize(n), up to n servos start together, and their trailing edges
+are serviced in order of pulse end:
+           ______
+Servo 1 __|      |________________________________________
+           ___
+Servo 2 __|   |___________________________________________
+           _________
+Servo 3 __|         |_____________________________________
+                     _____
+Servo 4 ____________|     |_______________________________
+          A   B  C  D     E                          A
+
+The members of a group are sorted by pulse duration when the group starts,
+and are started in that order, so their trailing edges come in the same
+order. Trailing edges closer together than JitterMargin are handled in one
+interrupt. The next group (servo 4 above, with a group size of 3) starts
+at the last trailing edge of the previous one, and the safe time starts
+at E. With groups of 8, 24 servos finish in about 8 ms of each 20 ms
+frame, leaving a long safe window for ServoCallback. The default group
+size of 1 is the classic one-at-a-time behavior.
+
+Servo Banks
+-----------
+Each timer drives one bank of servos with its own list, group, and
+interrupt handler. Bank 0 uses timer 1 and is always there. On a Mega
+(ATmega2560), uncomment GIZMO_GARDEN_SERVO_BANKS below to add banks 1,
+2, and 3 on timers 3, 4, and 5, for hexapods and other beasts with
+more servos than one bank can handle. Those timers are then not
+available for other uses, such as analogWrite on pins 2, 3, 5, 6, 7, 8,
+44, 45, and 46. Choose the bank with the last argument of the constructor
+or attach.
+
+The handlers of different banks can't interrupt each other, so a
+handler spin-waiting for a trailing edge would make any edge of another
+bank that comes first late, and a bigger margin wouldn't help, since it
+would only make the spin-waits longer. Instead, a handler ends the
+pulses of other banks that are due before its own edge, in order, and
+does the same before starting a group. The banks' handlers then take
+their turns in order of their edges, and the margin only has to cover
+everything else. Trailing edges of different banks that fall within a
+few CPU cycles of each other can't both be exactly on time.
+
+The frames of the banks start in step, each BankStagger microseconds
+after the one before, so that servos set the same in different banks,
+such as a hexapod standing still, don't have their trailing edges at
+the same time. Each bank keeps track of its own safe time. A
+ServoCallback runs only when all banks are between D and A, at the
+point D of whichever bank finishes last.
+
+Hardware Pulses
+---------------
+A servo on the B output-compare pin of its bank's timer, or the C pin on
+a Mega, is pulsed by the timer itself. At the start of each frame the
+interrupt handler forces the pin high and sets the compare register to
+the end of the pulse, and the timer clears the pin right on time. There
+is no interrupt or spin-wait for the trailing edge, and no jitter even
+if interrupts are off when it comes. The pins are:
+
+  Bank 0 (timer 1)  pin 10 on an Uno, 12 on a Mega
+  Bank 1 (timer 3)  pins 2 and 3
+  Bank 2 (timer 4)  pins 7 and 8
+  Bank 3 (timer 5)  pins 45 and 44
+
+Pin 13 of a Mega is also timer 1's C pin, but the Arduino core gives it
+to timer 0 for analogWrite, so a servo there is pulsed in software.
+The A pins (9 on an Uno) can't be used this way, because the handler
+needs their compare register for its own interrupts, so servos there
+are pulsed like any other. Nothing changes for the sketch; servos are
+written the same way on any pin.
+
+Pulse Trim
+----------
+A software pulse is as long as the time between two timer reads, the
+one just before the leading edge is written and the last one of the
+spin-wait before the trailing edge, plus however much longer the
+trailing edge takes to reach the pin than the leading edge. TrimTicks
+is added to make up that difference. Both edges are written directly
+to the port. Counting instructions, the leading edge reaches the pin 7
+to 13 CPU cycles after its timer read, depending on whether the
+compiler loads the port address before or after it. The trailing edge
+takes 10 to 17 cycles. The pulse is therefore 3 cycles short to 10
+long, within one timer tick (8 cycles), so TrimTicks is 0. Where the
+edges fall within their ticks adds up to 7 cycles either way, which no
+trim can fix. When the edges were written with digitalWrite, the
+leading one also waited for the compare register to be set, and
+TrimTicks was 2, measured with an oscilloscope.
+
+Idle Servos
+-----------
+A standard servo holding still keeps drawing current to fight any load,
+and its pulses keep the interrupt handler busy. With setIdleFrames(n),
+a servo whose pulse width hasn't changed for n frames, by a write or by
+its motion profile, stops getting pulses, and most servos then relax.
+Writing the same width again doesn't count as a change, so a control
+loop can keep writing a servo that has gotten where it's going and
+still let it go idle. The next write of a different width wakes it up.
+Only use this where the load won't move the servo when it relaxes.
+getIdleSavings tells how many pulses, and about how many interrupt
+handler cycles, idle servos are saving.
+
+Refresh Rate
+------------
+Digital servos can take pulses at 200 - 333 Hz and respond faster when
+they get them. Each bank has its own refresh interval, RefreshInterval
+by default, set with setRefreshInterval. A bank with a short interval
+runs its own frames, out of step with the others, and its safe time is
+short, so a long ServoCallback delays its next point A. That just
+lengthens one frame. If the pulses of a frame don't fit in the interval,
+the frame takes as long as they need. On an Uno there is only bank 0, so
+put analog servos and fast digital servos on different banks of a Mega
+to give each its own rate.
 
 Long-duration synchronization should be hidden from the sketch writer,
 who is unlikely to be sufficiently fluent in C++. See the the library
@@ -104,14 +243,36 @@ enum GizmoGardenServoParameters
   MinMaxAdjustScale =     2,  // log2 scale factor for minAdjust, maxAdjust
   DefaultPulseTime  =  1500,  // microseconds
   RefreshInterval   = 20000,  // nominal, may vary, microseconds
-  JitterMargin      =    25,  // microseconds
-  TrimTicks         =     2,  // timer clock ticks, emperical adjustment
-                              //   measured with oscilloscope
+  MinRefreshInterval=  2500,  // microseconds, shortest for setRefreshInterval
+  MaxRefreshInterval= 32000,  // microseconds, longest for setRefreshInterval
+  JitterMargin      =    25,  // microseconds, starting margin
+  MinJitterMargin   =     8,  // microseconds, least adaptive margin
+  MaxJitterMargin   =   100,  // microseconds, greatest adaptive margin
+  JitterGuard       =     4,  // microseconds added to measured lateness
+  MarginDecayFrames =     8,  // frames per tick of high-water mark decay
+  BankStagger       =    50,  // microseconds between bank frame starts
+  IdlePulseCycles   =   300,  // estimated handler cycles per software pulse,
+                              //   not counting the spin-wait
+  TrimTicks         =     0,  // timer clock ticks added to software
+                              //   pulses; see Pulse Trim below
 };
 
+// Uncomment to use timers 3, 4, and 5 for servo banks 1, 2, and 3. Has
+// no effect on boards that don't have those timers.
+//#define GIZMO_GARDEN_SERVO_BANKS
+
+#if defined(GIZMO_GARDEN_SERVO_BANKS) && defined(TCNT5)
+#define GIZMO_GARDEN_SERVO_BANK_COUNT 4
+#else
+#define GIZMO_GARDEN_SERVO_BANK_COUNT 1
+#endif
+
+class GizmoGardenServoBank;
+
 class ServoCallback
 {
   friend class GizmoGardenServo;
+  friend class GizmoGardenServoBank;
 
   // Maintain linked list of all ServoCallbacks
   static ServoCallback* list;
@@ -120,6 +281,13 @@ class ServoCallback
   // This callback needs to run at the next safe interrupt
   bool callbackScheduled;
 
+  // Microseconds of callbacks run so far in the current safe time, and the
+  // callback left waiting for lack of time, which goes first next time
+  static uint16_t safeTimeSpent;
+  static ServoCallback* resume;
+  static bool fits(uint16_t time);
+  static void runScheduled();
+
 protected:
   // Add or remove this ServoCallback from the global list
   ServoCallback();
@@ -129,12 +297,20 @@ protected:
   // scheduling for the next safe time
   void call();
 
-  // Cancel any pending callback
-  void cancel() { callbackScheduled = false; }
+  // Cancel any pending callback. Returns true if there was one.
+  bool cancel();
 
   // Override this to do whatever must be done with interrupts off.
   // Interrupts will be off when called, and must remain off.
   virtual void callback() = 0;
+
+  // Override this to give the microseconds callback will take, so it can
+  // be packed into safe times with others. See ServoCallback above.
+  virtual uint16_t callbackTime() { return 0; }
+
+public:
+  // Most microseconds of callbacks that are run in one safe time
+  enum { SafeTimeBudget = 13000 };
 };
 
 class GizmoGardenServo
@@ -143,7 +319,8 @@ public:
   // You can construct a servo with a pin number, so you don't need to
   // call attach. Making all of the arguments optional maintans compatibility
   // with the standard servo library.
-  GizmoGardenServo(int pin = -1, int minPulseTime = MinPulseTime, int maxPulseTime = MaxPulseTime);
+  GizmoGardenServo(int pin = -1, int minPulseTime = MinPulseTime, int maxPulseTime = MaxPulseTime,
+                   uint8_t bank = 0);
   ~GizmoGardenServo();
 
   // Enable or disable this servo, as specified by the argument. A disabled
@@ -168,9 +345,62 @@ public:
   // Returns current pulse width in microseconds
   int readMicroseconds();
 
+  // Batched updates. Between beginUpdate and endUpdate, writes to servos
+  // in any bank are staged instead of taking effect, and then all of
+  // them take effect together at the start of the next frame. Servos
+  // that must move together, such as the two wheels of a robot, are
+  // then never pulsed with one new and one old setting. Calls can nest,
+  // and the outermost endUpdate commits. Staging doesn't turn interrupts
+  // off. Reads return staged settings.
+  static void beginUpdate();
+  static void endUpdate();
+
+  // Motion profiles. With a speed limit set, writes set a target instead
+  // of the pulse width, and once per frame the interrupt handler moves
+  // the pulse width toward the target, speeding up and slowing down at
+  // the acceleration limit so that it comes to rest right at the target
+  // (a trapezoidal profile). Speed is in microseconds of pulse width per
+  // second, and acceleration in microseconds per second per second, 0 for
+  // no limit. These are converted using the refresh interval of the bank,
+  // so set that first. A speed of 0 turns the profile off, and the pulse
+  // width jumps to the target. Reads return the target, and isMoving tells
+  // if the pulse width has gotten there.
+  void setMotion(uint16_t speed, uint16_t acceleration = 0);
+  bool isMoving();
+
+  // Frame-synchronous timing. Returns a prediction of the millis() time
+  // that is offset milliseconds after point D (the start of the safe time)
+  // of the first frame whose point D is at least wait milliseconds from
+  // now. A GizmoGardenTask that passes this to callMeAt runs in the safe
+  // time, so a pixel show runs right away instead of waiting for the next
+  // point D, and the servo writes it makes all take effect in the next
+  // frame. This is not a signal from the interrupt handler. The handler
+  // records when bank 0 last started a frame, at point A, and the
+  // prediction adds whole refresh intervals and then the time to point D
+  // as if every servo pulse were as long as its maximum. Offset 0 is then
+  // surely past D however the pulse widths change, and later in the safe
+  // time by however much the pulses are shorter than their maximums. Banks
+  // with their own refresh interval aren't counted.
+  static uint32_t getFrameTime(uint16_t wait = 0, uint8_t offset = 0);
+
+  // True if this servo is pulsed by the timer hardware. See Hardware
+  // Pulses above.
+  bool isHardware() const { return channel != 0; }
+
+  // Stop pulsing this servo after the specified number of frames with no
+  // change, 0 to pulse it always (the default). See Idle Servos above.
+  void setIdleFrames(uint8_t frames);
+  bool isIdle() const { return idleFrames != 0 && quietFrames >= idleFrames; }
+
+  // Pulses not sent because their servos were idle, and an estimate of the
+  // interrupt handler CPU cycles that saved, both per second since the
+  // last call.
+  static void getIdleSavings(uint16_t& pulsesPerSecond, uint32_t& cyclesPerSecond);
+
   // The following attach/detatch functions are no longer necessary
   // but are provided for compatibility with the standard servo linrary.
-  void attach(int pin, int minTime = MinPulseTime, int maxTime = MaxPulseTime); 
+  void attach(int pin, int minTime = MinPulseTime, int maxTime = MaxPulseTime,
+              uint8_t bank = 0);
   void detach() { enable(false); }
   bool attached() { return isEnabled(); } 
 
@@ -179,25 +409,135 @@ public:
   // If you are using attach, it will do it if necessary.
   static void begin();
 
-  // The interrupt handler is made public so it can be called from
-  // SIGNAL. Don't call this otherwise.
+  // Number of servos pulsed together, 1 - MaxGroupSize. See Group Mode
+  // above. Takes effect at the next group.
+  enum { MaxGroupSize = 8 };
+  static void setGroupSize(uint8_t n);
+  static uint8_t getGroupSize() { return groupSize; }
+
+  // Number of servo banks, and the bank this servo is in. See Servo
+  // Banks above. A bank number that isn't there means bank 0.
+  enum { Banks = GIZMO_GARDEN_SERVO_BANK_COUNT };
+  uint8_t getBank() const { return bank; }
+
+  // Time from the start of one frame of the specified bank to the start
+  // of the next, in microseconds. See Refresh Rate above. Takes effect at
+  // the end of the current frame.
+  static void setRefreshInterval(uint16_t us, uint8_t bank = 0);
+  static uint16_t getRefreshInterval(uint8_t bank = 0);
+
+  // Adaptive jitter margin, all in microseconds. See Theory of Operation
+  // above. getLatency is the high-water mark of how late trailing-edge
+  // interrupts have arrived, and getSpinTime is the total time the
+  // specified bank spent spin-waiting in its last frame.
+  static uint16_t getJitterMargin();
+  static uint16_t getLatency();
+  static uint16_t getSpinTime(uint8_t bank = 0);
+
+  // Keep the margin covering at least this much interrupt lateness, in
+  // microseconds, plus JitterGuard. 0, the default, lets it adapt down to
+  // MinJitterMargin.
+  static void setMinLatency(uint16_t us);
+
+  // The interrupt handlers are made public so they can be called from
+  // SIGNAL. Don't call these otherwise.
+  template<uint8_t bank, class Timer>
   static void interruptHandler();
 
 private:
   friend class ServoCallback;
+  friend class GizmoGardenServoBank;
 
-  // Global linked list of all servos
-  static GizmoGardenServo* servoList;
-  static GizmoGardenServo* current;
+  static GizmoGardenServoBank banks[Banks];
+  uint8_t bank;
   GizmoGardenServo* next;
 
+  static uint8_t groupSize;
+
+  // False in the safe time between D and A of every bank
+  static bool inFrame();
+
+  // millis() at the last point A of bank 0, and the most microseconds
+  // from there to point D
+  static volatile uint32_t frameStart;
+  static uint32_t longestFrame();
+
+  // Batched update state. Writes during an update go to stagedTicks,
+  // which the interrupt handler never looks at. The outermost endUpdate
+  // moves them to pendingTicks and sets commitPending, and the handler
+  // commits them at the start of bank 0's next frame unless it catches
+  // endUpdate in the act (copying). This double buffer lets a new update
+  // begin before the last one is committed. pendingTicks is volatile so
+  // the compiler keeps its stores between the two stores to copying.
+  // Before the servos have started, endUpdate commits right away.
+  static uint8_t updateDepth;
+  static volatile bool copying;
+  static volatile bool commitPending;
+  static void commit();
+
+  // Motion profile state, in sixteenths of a timer tick per frame except
+  // targetTicks. maxSpeed is 0 if there is no profile, and profiles is
+  // the number of servos that have one, so the interrupt handler doesn't
+  // have to look when there are none. fraction is the part of the pulse
+  // width below one tick.
+  static uint8_t profiles;
+  uint16_t targetTicks;
+  int16_t velocity;
+  uint16_t maxSpeed;
+  uint8_t acceleration;
+  uint8_t fraction;
+  void stepMotion();
+
+  // Idle state. quietFrames counts frames since the last change, up to
+  // idleFrames. The savings are counted by the interrupt handler.
+  uint8_t idleFrames;
+  uint8_t quietFrames;
+  static uint32_t idlePulses;
+  static uint32_t idleCycles;
+
+  // Called for each pulse that is due. Count the frame and return false
+  // if this servo is idle.
+  bool awake()
+  {
+    if (idleFrames == 0)
+      return true;
+    if (quietFrames >= idleFrames)
+      return false;
+    ++quietFrames;
+    return true;
+  }
+
+  // Set the pulse width, or the target if there's a motion profile. Only
+  // a change keeps the servo awake.
+  void setTicks(uint16_t ticks)
+  {
+    uint16_t& setting = maxSpeed != 0 ? targetTicks : pulseTicks;
+    if (setting != ticks)
+    {
+      setting = ticks;
+      quietFrames = 0;
+    }
+  }
+
   // The sign bit of pin is set for disabled servos. If pin == -1, the
   // servo was constructed with no pin, and so attach must be called.
   // Otherwise, the pin number is pin & 0x7F.
   int8_t pin;
 
-  uint16_t pulseTicks;  // Current pulse duration in timer ticks
-  uint16_t pulseEnd;    // Timer count for trailing edge of pulse
+  // Port output register and bit mask for pin, looked up once so that
+  // the interrupt handler can write the pin directly, as GizmoGardenTone
+  // does.
+  volatile uint8_t* outputRegister;
+  uint8_t pinMask;
+
+  // Output-compare channel of the bank's timer that pulses this servo,
+  // 1 for B or 2 for C, or 0 if pulsed by software
+  uint8_t channel;
+
+  uint16_t pulseTicks;            // Current pulse duration in timer ticks
+  uint16_t stagedTicks;           // Staged pulse duration, 0 if none
+  volatile uint16_t pendingTicks; // Pulse duration awaiting commit, 0 if none
+  uint16_t pulseEnd;              // Timer count for trailing edge of pulse
 
   // As is done in the standard servo library, the min and max pulse
   // times are set as an offset from the hard min and max constants.
@@ -220,4 +560,66 @@ private:
   static uint16_t ticksToUs(uint16_t ticks) { return (uint16_t)(ticks * 8L / clockCyclesPerMicrosecond()); }
 };
 
+// One timer and the servos it pulses. The Timer template arguments
+// supply the registers of a particular timer, so that each bank's
+// interrupt handler accesses them as directly as when timer 1 was the
+// only choice.
+class GizmoGardenServoBank
+{
+  friend class GizmoGardenServo;
+  friend class ServoCallback;
+
+  // Linked list of the servos of this bank. current is the next servo to
+  // be considered for a group, and group holds the servos of the current
+  // group in order of pulse end, of which those from groupIndex on are
+  // still high.
+  GizmoGardenServo* servoList;
+  GizmoGardenServo* current;
+  GizmoGardenServo* group[GizmoGardenServo::MaxGroupSize];
+  uint8_t groupCount;
+  uint8_t groupIndex;
+
+  // Servos pulsed by output-compare channels B and C of the timer
+  GizmoGardenServo* hardware[2];
+
+  // Refresh interval in ticks, 0 for RefreshInterval
+  uint16_t refreshTicks;
+  uint16_t refresh() const
+  {
+    return refreshTicks != 0 ? refreshTicks : GizmoGardenServo::usToTicks(RefreshInterval);
+  }
+
+  // Adaptive jitter margin, all in timer ticks. lateMax is the leaky
+  // high-water mark of interrupt lateness, spinTicks accumulates the spin
+  // time of the frame in progress, and frameSpin holds that of the last one.
+  static uint8_t margin;
+  static uint8_t lateMax;
+  static uint8_t minLate;       // Floor under lateMax, from setMinLatency
+  static uint8_t decayCount;
+  uint16_t spinTicks;
+  uint16_t frameSpin;
+#if GIZMO_GARDEN_SERVO_BANK_COUNT > 1
+  static uint16_t lastSpinEnd;  // Timer 1 count when a spin-wait last ended
+  uint16_t clockOffset;         // Timer 1 count minus this timer's count
+  void endEarlierPulses(uint16_t due);
+#endif
+
+  // False in the safe time between D and A of this bank
+  bool inFrame() const { return current != 0 || groupCount != 0; }
+
+  // Add a servo to the end of the list, or remove one
+  void add(GizmoGardenServo*);
+  void remove(GizmoGardenServo*);
+
+  template<class Timer> void interruptHandler();
+  template<class Timer> void begin(uint16_t start);
+  template<class Timer> void startFrame(uint16_t delay);
+  template<class Timer> static void startHardware(GizmoGardenServo*, uint8_t channel);
+
+  // Set the margin from the high-water mark, which decays at the end of
+  // each frame
+  static void setMargin();
+  void endFrame();
+};
+
 #endif
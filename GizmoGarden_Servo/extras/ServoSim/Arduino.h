@@ -0,0 +1,94 @@
+#ifndef _ServoSimArduino_
+#define _ServoSimArduino_
+
+/********************************************************************
+Copyright (c) 2015 Bill Silver (gizmogarden.org). This source code is
+distributed under terms of the GNU General Public License, Version 3,
+which grants certain rights to copy, modify, and redistribute. The
+license can be found at <http://www.gnu.org/licenses/>. There is no
+express or implied warranty, including merchantability or fitness for
+a particular purpose.
+********************************************************************/
+
+// ***************************************
+// *                                     *
+// *  Arduino Stand-In for the Servo Sim  *
+// *                                     *
+// ***************************************
+
+// Just enough of the Arduino core and AVR registers for GizmoGardenServo
+// to compile on a host computer, with the 16-bit timers modeled by
+// ServoSim.cpp. Every pin is on its own port with bit mask 1, so the
+// simulator can watch each pin by itself.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef uint8_t byte;
+
+#define F_CPU 16000000UL
+#define clockCyclesPerMicrosecond() (F_CPU / 1000000L)
+#define _BV(bit) (1u << (bit))
+
+#define OUTPUT 1
+
+#define SIGNAL(vector) extern "C" void vector()
+
+inline void cli() {}
+
+unsigned long millis();
+unsigned long micros();
+void pinMode(uint8_t pin, uint8_t mode);
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+uint8_t digitalPinToPort(uint8_t pin);
+uint8_t digitalPinToBitMask(uint8_t pin);
+volatile uint8_t* portOutputRegister(uint8_t port);
+uint8_t digitalPinToTimer(uint8_t pin);
+
+enum
+{
+  NOT_ON_TIMER,
+  TIMER1A, TIMER1B, TIMER1C,
+  TIMER3A, TIMER3B, TIMER3C,
+  TIMER4A, TIMER4B, TIMER4C,
+  TIMER5A, TIMER5B, TIMER5C,
+};
+
+// Reading a timer count register lets one tick of simulated time go by,
+// so that spin-waits on the count finish. Writes take effect at the next
+// read. The timer 1 bit names serve for all timers, as in the servo code.
+volatile uint16_t& simCount(uint8_t timer);
+
+#define TCNT1 simCount(1)
+#define TCNT3 simCount(3)
+#define TCNT4 simCount(4)
+#define TCNT5 simCount(5)
+
+extern volatile uint8_t SREG;
+
+// Output-compare registers A, B, and C of each timer are in a row, as on
+// the AVR
+extern volatile uint16_t OCR1[3], OCR3[3], OCR4[3], OCR5[3];
+#define OCR1A OCR1[0]
+#define OCR1B OCR1[1]
+#define OCR1C OCR1[2]
+#define OCR3A OCR3[0]
+#define OCR4A OCR4[0]
+#define OCR5A OCR5[0]
+
+extern volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIFR1, TIMSK1;
+extern volatile uint8_t TCCR3A, TCCR3B, TCCR3C, TIFR3, TIMSK3;
+extern volatile uint8_t TCCR4A, TCCR4B, TCCR4C, TIFR4, TIMSK4;
+extern volatile uint8_t TCCR5A, TCCR5B, TCCR5C, TIFR5, TIMSK5;
+
+enum
+{
+  CS11   = 1,
+  OCF1A  = 1,
+  OCIE1A = 1,
+  COM1A0 = 6,
+  FOC1A  = 7,
+};
+
+#endif
@@ -0,0 +1,776 @@
+/********************************************************************
+Copyright (c) 2015 Bill Silver (gizmogarden.org). This source code is
+distributed under terms of the GNU General Public License, Version 3,
+which grants certain rights to copy, modify, and redistribute. The
+license can be found at <http://www.gnu.org/licenses/>. There is no
+express or implied warranty, including merchantability or fitness for
+a particular purpose.
+********************************************************************/
+
+// *************************
+// *                       *
+// *  Servo Simulator Test  *
+// *                       *
+// *************************
+
+// Runs the GizmoGardenServo interrupt handlers on a host computer against
+// a model of the 16-bit timers, watches every pin, and checks the pulse
+// widths and frame periods that come out. See README.md for how to build
+// and run it.
+//
+// Simulated time is in timer ticks (0.5 us). Time goes by one tick per
+// step of the main loop, and one tick each time the servo code reads a
+// timer count, so a spin-wait takes as long as it waits for. A compare
+// match sets a flag when the count steps onto the compare register, and
+// the main loop calls the interrupt handler when it sees the flag, as
+// the AVR would with interrupts on.
+
+#include <stdio.h>
+#include "../../GizmoGardenServo.h"
+
+// *********************
+// *                   *
+// *  Simulated Clock  *
+// *                   *
+// *********************
+
+static uint32_t now;
+
+unsigned long millis() { return now / 2000; }
+unsigned long micros() { return now / 2; }
+
+long map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+volatile uint8_t SREG;
+volatile uint16_t OCR1[3], OCR3[3], OCR4[3], OCR5[3];
+volatile uint8_t TCCR1A, TCCR1B, TCCR1C, TIFR1, TIMSK1;
+volatile uint8_t TCCR3A, TCCR3B, TCCR3C, TIFR3, TIMSK3;
+volatile uint8_t TCCR4A, TCCR4B, TCCR4C, TIFR4, TIMSK4;
+volatile uint8_t TCCR5A, TCCR5B, TCCR5C, TIFR5, TIMSK5;
+
+// Output-compare pins, as on an Uno, or a Mega when simulating banks
+struct TimerPin
+{
+  uint8_t pin, timer;
+};
+
+static const TimerPin timerPins[] =
+{
+#if GIZMO_GARDEN_SERVO_BANK_COUNT > 1
+  { 11, TIMER1A }, { 12, TIMER1B }, { 13, TIMER1C },
+  {  5, TIMER3A }, {  2, TIMER3B }, {  3, TIMER3C },
+  {  6, TIMER4A }, {  7, TIMER4B }, {  8, TIMER4C },
+  { 46, TIMER5A }, { 45, TIMER5B }, { 44, TIMER5C },
+#else
+  {  9, TIMER1A }, { 10, TIMER1B },
+#endif
+};
+
+uint8_t digitalPinToTimer(uint8_t pin)
+{
+  for (uint8_t i = 0; i < sizeof(timerPins) / sizeof(timerPins[0]); ++i)
+    if (timerPins[i].pin == pin)
+      return timerPins[i].timer;
+  return NOT_ON_TIMER;
+}
+
+static void drivePin(uint8_t pin, uint8_t level);
+
+extern "C" void TIMER1_COMPA_vect();
+#if GIZMO_GARDEN_SERVO_BANK_COUNT > 1
+extern "C" void TIMER3_COMPA_vect();
+extern "C" void TIMER4_COMPA_vect();
+extern "C" void TIMER5_COMPA_vect();
+#endif
+
+struct SimTimer
+{
+  volatile uint16_t count;  // the count register as the servo code sees it
+  uint16_t seen;            // what the simulator last put there
+  uint32_t base;            // time when the count was 0
+  bool match;               // compare match waiting for its interrupt
+
+  volatile uint16_t* ocr;   // A, B, and C
+  volatile uint8_t* tccra;
+  volatile uint8_t* tccrc;
+  volatile uint8_t* timsk;
+  void (*vector)();
+  uint8_t firstTimer;       // TIMERnA of this timer, for its pins
+
+  // Follow the clock, noticing any count the servo code wrote since the
+  // last step, and flag a compare match when the count steps onto OCRnA.
+  // Channels B and C drive their pins as set by the compare output mode
+  // bits, on a forced or real compare match.
+  void step()
+  {
+    if (count != seen)
+      base = now - count;
+    uint16_t c = (uint16_t)(now - base);
+    bool stepped = c != seen;
+    if (stepped && c == ocr[0])
+      match = true;
+
+    for (uint8_t ch = 1; ch < 3; ++ch)
+    {
+      uint8_t mode = *tccra >> (COM1A0 - 2 * ch) & 3;
+      bool forced = (*tccrc & _BV(FOC1A - ch)) != 0;
+      if (mode >= 2 && (forced || (stepped && c == ocr[ch])))
+        for (uint8_t i = 0; i < sizeof(timerPins) / sizeof(timerPins[0]); ++i)
+          if (timerPins[i].timer == firstTimer + ch)
+            drivePin(timerPins[i].pin, mode == 3);
+    }
+    *tccrc = 0;
+    count = seen = c;
+  }
+};
+
+static SimTimer timers[] =
+{
+  { 0, 0, 0, false, OCR1, &TCCR1A, &TCCR1C, &TIMSK1, TIMER1_COMPA_vect, TIMER1A },
+#if GIZMO_GARDEN_SERVO_BANK_COUNT > 1
+  { 0, 0, 0, false, OCR3, &TCCR3A, &TCCR3C, &TIMSK3, TIMER3_COMPA_vect, TIMER3A },
+  { 0, 0, 0, false, OCR4, &TCCR4A, &TCCR4C, &TIMSK4, TIMER4_COMPA_vect, TIMER4A },
+  { 0, 0, 0, false, OCR5, &TCCR5A, &TCCR5C, &TIMSK5, TIMER5_COMPA_vect, TIMER5A },
+#endif
+};
+
+static const uint8_t TimerCount = sizeof(timers) / sizeof(timers[0]);
+
+static SimTimer& timerOf(uint8_t n)
+{
+  return timers[n == 1 ? 0 : n - 2];
+}
+
+// *******************
+// *                 *
+// *  Simulated Pins  *
+// *                 *
+// *******************
+
+enum
+{
+  PinCount       = 64,
+  HistogramRange =  8,  // ticks each way from the expected width
+};
+
+struct SimPin
+{
+  volatile uint8_t port;
+  uint8_t level;
+
+  uint16_t expect;          // expected pulse width in ticks, 0 if not watched
+  uint32_t rise;            // time of the last leading edge
+  uint32_t pulses;
+  int16_t errorMin, errorMax;
+  uint32_t periodMin, periodMax;
+
+  // Width errors from -HistogramRange to +HistogramRange ticks, with the
+  // ones beyond that at each end
+  uint32_t histogram[2 * HistogramRange + 3];
+
+  void watch(uint16_t ticks)
+  {
+    expect = ticks;
+    pulses = 0;
+    errorMin = 32767;
+    errorMax = -32768;
+    periodMin = 0xFFFFFFFF;
+    periodMax = 0;
+    memset(histogram, 0, sizeof(histogram));
+  }
+
+  void step()
+  {
+    if (port == level)
+      return;
+    level = port;
+    if (expect == 0)
+      return;
+
+    if (level)
+    {
+      if (pulses > 0)
+      {
+        uint32_t period = now - rise;
+        if (period < periodMin) periodMin = period;
+        if (period > periodMax) periodMax = period;
+      }
+      rise = now;
+    }
+    else if (rise != 0)
+    {
+      int16_t error = (int16_t)(now - rise - expect);
+      if (error < errorMin) errorMin = error;
+      if (error > errorMax) errorMax = error;
+      int16_t bin = error < -HistogramRange ? -HistogramRange - 1 :
+                    error >  HistogramRange ?  HistogramRange + 1 : error;
+      ++histogram[bin + HistogramRange + 1];
+      ++pulses;
+    }
+  }
+};
+
+static SimPin pins[PinCount];
+static uint8_t watched[PinCount];
+static uint8_t watchedCount = 0;
+
+static void drivePin(uint8_t pin, uint8_t level)
+{
+  pins[pin].port = level;
+}
+
+void pinMode(uint8_t, uint8_t) {}
+uint8_t digitalPinToPort(uint8_t pin) { return pin; }
+uint8_t digitalPinToBitMask(uint8_t) { return 1; }
+volatile uint8_t* portOutputRegister(uint8_t port) { return &pins[port].port; }
+
+// One tick goes by
+static void tick()
+{
+  for (uint8_t i = 0; i < TimerCount; ++i)
+    timers[i].step();
+  for (uint8_t i = 0; i < watchedCount; ++i)
+    pins[watched[i]].step();
+  ++now;
+  for (uint8_t i = 0; i < TimerCount; ++i)
+    timers[i].step();
+}
+
+volatile uint16_t& simCount(uint8_t n)
+{
+  tick();
+  return timerOf(n).count;
+}
+
+// ******************
+// *                *
+// *  Interference  *
+// *                *
+// ******************
+
+// Interrupts are off until this time
+static uint32_t blockedUntil = 0;
+
+static uint32_t randomState = 1;
+
+static uint32_t randomBelow(uint32_t n)
+{
+  randomState = randomState * 1103515245 + 12345;
+  return (randomState >> 8) % n;
+}
+
+// Short events that turn interrupts off, such as other interrupt handlers,
+// at random times averaging every period ticks, for duration ticks
+struct Interference
+{
+  uint32_t duration;
+  uint32_t period;
+  uint32_t next;
+  uint32_t count;
+
+  void step()
+  {
+    if (duration == 0 || now < next)
+      return;
+    blockedUntil = now + duration;
+    next = now + 1 + randomBelow(2 * period);
+    ++count;
+  }
+};
+
+static Interference interference = { 0, 0, 0, 0 };
+
+// A long event that needs the servos' safe time, such as a NeoPixel show,
+// requested every period ticks and running for duration ticks with
+// interrupts off
+class SimShow : private ServoCallback
+{
+public:
+  uint32_t duration;
+  uint32_t period;
+  uint32_t next;
+  uint32_t requested;       // time of the request waiting for its callback
+  uint32_t count;
+  uint32_t waitMax;         // longest wait for the safe time
+  uint32_t pinsHigh;        // callbacks that found a pin high
+
+  void step()
+  {
+    if (duration == 0 || now < next)
+      return;
+    next = now + period;
+    requested = now;
+    call();
+  }
+
+protected:
+  virtual void callback()
+  {
+    for (uint8_t i = 0; i < watchedCount; ++i)
+      if (pins[watched[i]].port != 0)
+        ++pinsHigh;
+    if (now - requested > waitMax)
+      waitMax = now - requested;
+    blockedUntil = now + duration;
+    ++count;
+  }
+};
+
+static SimShow show;
+
+// Take an interrupt if one is waiting and interrupts are on, or else let
+// one tick go by
+static void step()
+{
+  if (now < blockedUntil)
+  {
+    tick();
+    return;
+  }
+
+  for (uint8_t i = 0; i < TimerCount; ++i)
+  {
+    SimTimer& t = timers[i];
+    t.step();
+    if (t.match && (*t.timsk & _BV(OCIE1A)) != 0)
+    {
+      t.match = false;
+      t.vector();
+      return;
+    }
+  }
+
+  interference.step();
+  show.step();
+  tick();
+}
+
+// Run for the specified number of milliseconds
+static void run(uint32_t ms)
+{
+  uint32_t end = now + 2000 * ms;
+  while (now < end)
+    step();
+}
+
+// *************
+// *           *
+// *  Results  *
+// *           *
+// *************
+
+static int failures = 0;
+
+// Ticks a pulse width may be off and still be in trim. Simulated edges come
+// right on the tick, so this only has to allow for the handler's own timer
+// reads, and matches the 1 us that TrimTicks used to cover.
+enum { WidthSlop = 2 };
+
+// Check the pulses of a pin. Every width must be within WidthSlop of the
+// setting plus TrimTicks, and every period within a few microseconds of
+// the refresh interval, or longer if the frame doesn't fit in it.
+static void check(uint8_t pin, uint16_t us, uint16_t interval, bool stretched = false)
+{
+  SimPin& p = pins[pin];
+  const uint16_t periodSlop = 20;   // ticks
+  bool ok = p.pulses > 0 && p.errorMin >= -WidthSlop && p.errorMax <= WidthSlop;
+  if (stretched)
+    ok = ok && p.periodMin >= 2UL * interval;
+  else
+    ok = ok && p.periodMin >= 2UL * interval && p.periodMax <= 2UL * interval + periodSlop;
+
+  printf("  pin %2d  %4u us  %5lu pulses  width error %+5.1f .. %+5.1f us  period %7.1f .. %7.1f us  %s\n",
+         pin, us, (unsigned long)p.pulses, p.errorMin / 2.0, p.errorMax / 2.0,
+         p.periodMin / 2.0, p.periodMax / 2.0, ok ? "ok" : "FAIL");
+  if (!ok)
+    ++failures;
+}
+
+// Software pulses get TrimTicks added, and hardware pulses don't need it
+static void watch(GizmoGardenServo* s, uint8_t pin, uint16_t us)
+{
+  if (pins[pin].expect == 0)
+    watched[watchedCount++] = pin;
+  pins[pin].watch(2 * us + (s->isHardware() ? 0 : TrimTicks));
+}
+
+static GizmoGardenServo* addServo(uint8_t pin, uint16_t us, uint8_t bank = 0)
+{
+  GizmoGardenServo* s = new GizmoGardenServo(pin, MinPulseTime, MaxPulseTime, bank);
+  s->writeMicroseconds(us);
+  watch(s, pin, us);
+  return s;
+}
+
+// ***********
+// *         *
+// *  Tests  *
+// *         *
+// ***********
+
+// A dozen servos at assorted widths, at the standard refresh interval
+static void testWidths()
+{
+  printf("widths: 12 servos at %u us refresh\n", RefreshInterval);
+  for (uint8_t i = 0; i < 12; ++i)
+    addServo(2 + i, 600 + i * 137 % 1800);
+  GizmoGardenServo::begin();
+  run(1000);
+  for (uint8_t i = 0; i < 12; ++i)
+    check(2 + i, 600 + i * 137 % 1800, RefreshInterval);
+}
+
+// Digital servos at 300 Hz on bank 0, and then two that don't fit in the
+// interval and stretch the frame. On a Mega with banks, analog servos on
+// bank 1 keep the standard interval meanwhile.
+static void testRefresh()
+{
+  const uint16_t fast = 3333;
+  printf("refresh: bank 0 at %u us\n", fast);
+  GizmoGardenServo::setRefreshInterval(fast);
+  GizmoGardenServo* a = addServo(2, 1500);
+  GizmoGardenServo* b = addServo(3, 1000);
+#if GIZMO_GARDEN_SERVO_BANK_COUNT > 1
+  addServo(4, 1200, 1);
+  addServo(5, 2100, 1);
+#endif
+  GizmoGardenServo::begin();
+  run(1000);
+  check(2, 1500, fast);
+  check(3, 1000, fast);
+#if GIZMO_GARDEN_SERVO_BANK_COUNT > 1
+  check(4, 1200, RefreshInterval);
+  check(5, 2100, RefreshInterval);
+#endif
+
+  printf("refresh: frame longer than %u us\n", MinRefreshInterval);
+  GizmoGardenServo::setRefreshInterval(MinRefreshInterval);
+  a->writeMicroseconds(2000);
+  b->writeMicroseconds(1800);
+  run(20);
+  watch(a, 2, 2000);
+  watch(b, 3, 1800);
+  run(1000);
+  check(2, 2000, MinRefreshInterval, true);
+  check(3, 1800, MinRefreshInterval, true);
+}
+
+// Servos on the output-compare pins of each bank's timer are pulsed by
+// the hardware, alongside software servos, including the one on the A
+// pin that the timer's interrupts need.
+static void testHardware()
+{
+#if GIZMO_GARDEN_SERVO_BANK_COUNT > 1
+  static const uint8_t hardwarePins[] = { 12, 13, 2, 3, 7, 8, 45, 44 };
+  static const uint8_t softwarePins[] = { 11, 22, 23, 24 };
+#else
+  static const uint8_t hardwarePins[] = { 10 };
+  static const uint8_t softwarePins[] = { 9, 2, 3, 4 };
+#endif
+  const uint8_t hardwareCount = sizeof(hardwarePins);
+  const uint8_t softwareCount = sizeof(softwarePins);
+
+  printf("hardware: %u hardware and %u software servos\n", hardwareCount, softwareCount);
+  for (uint8_t i = 0; i < hardwareCount; ++i)
+  {
+    GizmoGardenServo* s = addServo(hardwarePins[i], 1000 + 100 * i, i / 2);
+    if (!s->isHardware())
+    {
+      printf("  pin %2d  not pulsed by hardware  FAIL\n", hardwarePins[i]);
+      ++failures;
+    }
+  }
+  for (uint8_t i = 0; i < softwareCount; ++i)
+    addServo(softwarePins[i], 1050 + 100 * i, i % GizmoGardenServo::Banks);
+
+  GizmoGardenServo::begin();
+  run(1000);
+  for (uint8_t i = 0; i < hardwareCount; ++i)
+    check(hardwarePins[i], 1000 + 100 * i, RefreshInterval);
+  for (uint8_t i = 0; i < softwareCount; ++i)
+    check(softwarePins[i], 1050 + 100 * i, RefreshInterval);
+}
+
+// An idle servo gets idleFrames pulses after a write and then no more.
+// Writing the same width again doesn't wake it, and writing a different
+// one does.
+static void checkCount(uint8_t pin, uint16_t expected)
+{
+  bool ok = pins[pin].pulses == expected;
+  printf("  pin %2d  %5lu pulses, expected %u  %s\n", pin, (unsigned long)pins[pin].pulses, expected,
+         ok ? "ok" : "FAIL");
+  if (!ok)
+    ++failures;
+}
+
+static void testIdle()
+{
+#if GIZMO_GARDEN_SERVO_BANK_COUNT > 1
+  const uint8_t hardwarePin = 12;
+#else
+  const uint8_t hardwarePin = 10;
+#endif
+  const uint8_t frames = 10;
+
+  printf("idle: after %u frames\n", frames);
+  GizmoGardenServo* a = addServo(2, 1200);
+  addServo(3, 1700);
+  GizmoGardenServo* h = addServo(hardwarePin, 1500);
+  a->setIdleFrames(frames);
+  h->setIdleFrames(frames);
+  GizmoGardenServo::begin();
+  run(1000);
+  checkCount(2, frames);
+  checkCount(3, 1000000L / RefreshInterval);
+  checkCount(hardwarePin, frames);
+
+  printf("idle: same width written every frame\n");
+  watch(a, 2, 1200);
+  watch(h, hardwarePin, 1500);
+  for (uint8_t i = 0; i < 50; ++i)
+  {
+    a->writeMicroseconds(1200);
+    h->writeMicroseconds(1500);
+    run(RefreshInterval / 1000);
+  }
+  checkCount(2, 0);
+  checkCount(hardwarePin, 0);
+
+  printf("idle: woken by writes\n");
+  a->writeMicroseconds(1300);
+  h->writeMicroseconds(1600);
+  watch(a, 2, 1300);
+  watch(h, hardwarePin, 1600);
+  run(1000);
+  check(2, 1300, RefreshInterval);
+  check(hardwarePin, 1600, RefreshInterval);
+  checkCount(2, frames);
+  checkCount(hardwarePin, frames);
+
+  uint16_t pulses;
+  uint32_t cycles;
+  GizmoGardenServo::getIdleSavings(pulses, cycles);
+  printf("  saving %u pulses and about %lu cycles per second\n", pulses, (unsigned long)cycles);
+}
+
+// getFrameTime must land in the safe time, with every pin low, however
+// the pulse widths change in the meantime. Servos in groups of 3 are
+// written at random widths between checks, and each check waits a random
+// time.
+static void testFrameTime()
+{
+  const uint8_t n = 10;
+  const uint16_t checks = 2000;
+  printf("frametime: %u servos in groups of 3, %u checks\n", n, checks);
+
+  GizmoGardenServo* servos[n];
+  for (uint8_t i = 0; i < n; ++i)
+    servos[i] = addServo(2 + i, 1000, i % GizmoGardenServo::Banks);
+  GizmoGardenServo::setGroupSize(3);
+  GizmoGardenServo::begin();
+  run(100);
+
+  uint16_t bad = 0;
+  uint32_t leftMin = 0xFFFFFFFF;
+  for (uint16_t c = 0; c < checks; ++c)
+  {
+    for (uint8_t i = 0; i < n; ++i)
+      if (randomBelow(3) == 0)
+        servos[i]->writeMicroseconds(MinPulseTime + randomBelow(MaxPulseTime - MinPulseTime + 1));
+
+    uint16_t wait = (uint16_t)randomBelow(50);
+    uint32_t t = GizmoGardenServo::getFrameTime(wait);
+    bool early = t < millis() + wait;
+    while (millis() < t)
+      step();
+
+    bool high = false;
+    for (uint8_t i = 0; i < n; ++i)
+      high = high || pins[2 + i].port != 0;
+    if (early || high)
+      ++bad;
+
+    // Time left before the next frame starts
+    uint32_t start = now;
+    for (bool rose = false; !rose; )
+    {
+      step();
+      for (uint8_t i = 0; i < n; ++i)
+        rose = rose || pins[2 + i].port != 0;
+    }
+    if (now - start < leftMin)
+      leftMin = now - start;
+  }
+
+  printf("  %u of %u checks too early or with a pin high, at least %.1f ms of safe time left  %s\n",
+         bad, checks, leftMin / 2000.0, bad == 0 ? "ok" : "FAIL");
+  if (bad != 0)
+    ++failures;
+}
+
+// Options for the jitter test, name=value on the command line
+struct Option
+{
+  const char* name;
+  long value;
+};
+
+static Option options[] =
+{
+  { "servos",   12 },   // number of servos
+  { "group",     1 },   // group size
+  { "off",       0 },   // microseconds of each short interrupts-off event
+  { "every",     5 },   // average milliseconds between them
+  { "show",      0 },   // milliseconds of each long interrupts-off event
+  { "period",   40 },   // milliseconds between them
+  { "seconds",  10 },   // simulated time
+  { "seed",      1 },   // for the random numbers
+  { "floor",     0 },   // microseconds for setMinLatency
+};
+
+static long option(const char* name)
+{
+  for (uint8_t i = 0; i < sizeof(options) / sizeof(options[0]); ++i)
+    if (strcmp(options[i].name, name) == 0)
+      return options[i].value;
+  return 0;
+}
+
+static bool setOption(const char* arg)
+{
+  const char* eq = strchr(arg, '=');
+  if (eq != 0)
+    for (uint8_t i = 0; i < sizeof(options) / sizeof(options[0]); ++i)
+      if (strncmp(options[i].name, arg, eq - arg) == 0 && options[i].name[eq - arg] == 0)
+      {
+        options[i].value = atol(eq + 1);
+        return true;
+      }
+  return false;
+}
+
+static void printHistogram(const uint32_t* histogram)
+{
+  for (int16_t bin = -HistogramRange - 1; bin <= HistogramRange + 1; ++bin)
+  {
+    uint32_t n = histogram[bin + HistogramRange + 1];
+    if (n == 0)
+      continue;
+    if (bin < -HistogramRange)
+      printf("  <%+.1f:%lu", -HistogramRange / 2.0, (unsigned long)n);
+    else if (bin > HistogramRange)
+      printf("  >%+.1f:%lu", HistogramRange / 2.0, (unsigned long)n);
+    else
+      printf("  %+.1f:%lu", bin / 2.0, (unsigned long)n);
+  }
+  printf("\n");
+}
+
+// Pulse width error histograms, in microseconds, for servos at assorted
+// widths, with interference as specified by the options. Prints the
+// results for use as a benchmark. Interference now and then makes a pulse
+// late, but the margin should soon cover it, so a pin that is out of trim
+// on more than 1 in SteadyLateRatio of its pulses fails, as does a long
+// event called back with a pulse in progress.
+enum { SteadyLateRatio = 50 };
+
+static void testJitter()
+{
+  long servos = option("servos");
+  uint8_t n = (uint8_t)(servos < 1 ? 1 : servos > 48 ? 48 : servos);
+  interference.duration = 2 * option("off");
+  interference.period = 2000 * (option("every") > 0 ? option("every") : 1);
+  show.duration = 2000 * option("show");
+  show.period = 2000 * (option("period") > 0 ? option("period") : 1);
+  randomState = (uint32_t)option("seed");
+
+  printf("jitter: %u servos, group %ld, %ld us off every %ld ms, %ld ms show every %ld ms, %ld s\n",
+         n, option("group"), option("off"), option("every"), option("show"),
+         option("period"), option("seconds"));
+
+  for (uint8_t i = 0; i < n; ++i)
+    addServo(2 + i, 600 + i * 137 % 1800, i % GizmoGardenServo::Banks);
+  GizmoGardenServo::setGroupSize((uint8_t)option("group"));
+  GizmoGardenServo::setMinLatency((uint16_t)option("floor"));
+  GizmoGardenServo::begin();
+  run(1000 * option("seconds"));
+
+  uint32_t total[2 * HistogramRange + 3];
+  memset(total, 0, sizeof(total));
+  uint32_t pulses = 0, bad = 0;
+  uint8_t steady = 0;
+  for (uint8_t i = 0; i < n; ++i)
+  {
+    SimPin& p = pins[2 + i];
+    printf("  pin %2d  %4u us  %5lu pulses ", 2 + i, 600 + i * 137 % 1800, (unsigned long)p.pulses);
+    printHistogram(p.histogram);
+    uint32_t pinBad = 0;
+    for (uint8_t b = 0; b < 2 * HistogramRange + 3; ++b)
+    {
+      total[b] += p.histogram[b];
+      pulses += p.histogram[b];
+      int16_t error = b - HistogramRange - 1;
+      if (error < -WidthSlop || error > WidthSlop)
+        pinBad += p.histogram[b];
+    }
+    bad += pinBad;
+    if (pinBad * SteadyLateRatio > p.pulses)
+      ++steady;
+  }
+  printf("  all     %6lu pulses ", (unsigned long)pulses);
+  printHistogram(total);
+
+  printf("  %lu out of trim, margin %u us, latency %u us, spin",
+         (unsigned long)bad, GizmoGardenServo::getJitterMargin(), GizmoGardenServo::getLatency());
+  for (uint8_t b = 0; b < GizmoGardenServo::Banks; ++b)
+    printf(" %u", GizmoGardenServo::getSpinTime(b));
+  printf(" us/frame, %lu events, %lu shows, longest wait %.1f ms\n",
+         (unsigned long)interference.count, (unsigned long)show.count, show.waitMax / 2000.0);
+
+  if (steady != 0)
+  {
+    printf("  %u pins out of trim on more than 1 in %u pulses\n", steady, SteadyLateRatio);
+    ++failures;
+  }
+
+  if (show.pinsHigh != 0)
+  {
+    printf("  %lu show callbacks with a pulse in progress\n", (unsigned long)show.pinsHigh);
+    ++failures;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  const char* test = argc > 1 ? argv[1] : "widths";
+  for (int i = 2; i < argc; ++i)
+    if (!setOption(argv[i]))
+    {
+      printf("unknown option %s\n", argv[i]);
+      return 2;
+    }
+
+  if (strcmp(test, "widths") == 0)
+    testWidths();
+  else if (strcmp(test, "refresh") == 0)
+    testRefresh();
+  else if (strcmp(test, "hardware") == 0)
+    testHardware();
+  else if (strcmp(test, "idle") == 0)
+    testIdle();
+  else if (strcmp(test, "frametime") == 0)
+    testFrameTime();
+  else if (strcmp(test, "jitter") == 0)
+    testJitter();
+  else
+  {
+    printf("unknown test %s, use widths, refresh, hardware, idle, frametime, or jitter\n", test);
+    return 2;
+  }
+
+  printf("%s\n", failures == 0 ? "PASS" : "FAIL");
+  return failures == 0 ? 0 : 1;
+}
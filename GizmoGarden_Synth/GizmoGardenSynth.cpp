@@ -0,0 +1,228 @@
+/********************************************************************
+Copyright (c) 2015 Bill Silver (gizmogarden.org). This source code is
+distributed under terms of the GNU General Public License, Version 3,
+which grants certain rights to copy, modify, and redistribute. The
+license can be found at <http://www.gnu.org/licenses/>. There is no
+express or implied warranty, including merchantability or fitness for
+a particular purpose.
+********************************************************************/
+
+#include "GizmoGardenSynth.h"
+
+// You can use a different 8-bit timer by changing these macros
+#define TCNT  TCNT2
+#define OCRA  OCR2A
+#define OCRB  OCR2B
+#define TCCRA TCCR2A
+#define TCCRB TCCR2B
+#define TIMSK TIMSK2
+#define TOIE  TOIE2
+#define TVEC  TIMER2_OVF_vect
+#define COMB1 COM2B1
+#define WGM0  WGM20
+#define WGM1  WGM21
+#define WGM2  WGM22
+#define CS1   CS21
+
+#if defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+#define OCB_PIN  9
+#else
+#define OCB_PIN  3
+#endif
+
+// Prescale 8 and TOP 127 give F_CPU / 1024 samples per second, with
+// 128 levels. The 16-bit phase of each voice advances by frequency
+// * 65536 / GizmoGardenSynthRate each sample, and its top bit is the
+// square wave. Chord durations are counted in blocks of 16 samples.
+enum
+{
+  Top         = 127,
+  BlockShift  = 4
+};
+
+struct Chord
+{
+  uint16_t steps[GizmoGardenSynthVoices];
+  uint16_t blocks;
+};
+
+// Voice state used by the interrupt
+uint16_t synthPhases[GizmoGardenSynthVoices];
+uint16_t synthSteps[GizmoGardenSynthVoices];
+uint8_t  synthLevels[GizmoGardenSynthVoices];
+uint16_t synthBlocks;
+uint8_t  synthSample;
+uint8_t  sampleCount;
+
+Chord chordQueue[GizmoGardenSynthQueueSize];
+volatile uint8_t chordHead;
+volatile uint8_t chordCount;
+
+uint8_t voiceVolumes[GizmoGardenSynthVoices] =
+{
+  GizmoGardenSynthMaxVolume, GizmoGardenSynthMaxVolume,
+  GizmoGardenSynthMaxVolume, GizmoGardenSynthMaxVolume
+};
+
+void GizmoGardenSynthBegin()
+{
+  pinMode(OCB_PIN, OUTPUT);
+  digitalWrite(OCB_PIN, LOW);
+
+  // Fast PWM with TOP in OCRA. OCB is connected only while playing.
+  OCRA  = Top;
+  OCRB  = 0;
+  TCCRA = _BV(WGM1) | _BV(WGM0);
+  TCCRB = _BV(WGM2) | _BV(CS1);
+}
+
+// Call with the timer interrupt disabled, or from the interrupt.
+void loadChord(const Chord& chord)
+{
+  for (uint8_t i = 0; i < GizmoGardenSynthVoices; ++i)
+  {
+    synthSteps[i] = chord.steps[i];
+    synthLevels[i] = chord.steps[i] != 0 ? voiceVolumes[i] : 0;
+  }
+  synthBlocks = chord.blocks;
+}
+
+void silenceSynth()
+{
+  TIMSK &= ~_BV(TOIE);
+  TCCRA &= ~_BV(COMB1);
+  OCRB = 0;
+}
+
+ISR(TVEC)
+{
+  // Output the sample computed last time, so that the time it takes to
+  // compute doesn't matter.
+  OCRB = synthSample;
+
+  // Hopefully the compiler will unroll this loop
+  uint8_t s = 0;
+  for (uint8_t i = 0; i < GizmoGardenSynthVoices; ++i)
+  {
+    synthPhases[i] += synthSteps[i];
+    if ((synthPhases[i] & 0x8000) != 0)
+      s += synthLevels[i];
+  }
+  synthSample = s;
+
+  if ((++sampleCount & ((1 << BlockShift) - 1)) == 0 && --synthBlocks == 0)
+  {
+    if (chordCount == 0)
+      silenceSynth();
+    else
+    {
+      loadChord(chordQueue[chordHead]);
+      chordHead = (chordHead + 1) % GizmoGardenSynthQueueSize;
+      --chordCount;
+    }
+  }
+}
+
+bool GizmoGardenSynthPlaying()
+{
+  return (TIMSK & _BV(TOIE)) != 0;
+}
+
+bool GizmoGardenSynthQueue(const uint16_t* frequencies, uint8_t count, uint16_t duration)
+{
+  Chord chord;
+  for (uint8_t i = 0; i < GizmoGardenSynthVoices; ++i)
+    chord.steps[i] = i < count && frequencies[i] < GizmoGardenSynthRate / 2 ?
+                     (uint16_t)(((uint32_t)frequencies[i] << 16) / GizmoGardenSynthRate) : 0;
+
+  // Round to the nearest block, so that the errors of queued chords don't all
+  // add up in the same direction.
+  uint32_t b = ((uint32_t)duration * GizmoGardenSynthRate + (1000 << (BlockShift - 1))) /
+               (1000 << BlockShift);
+  chord.blocks = b > 0 ? b : 1;
+
+  bool ok = true;
+  uint8_t sreg = SREG;
+  cli();
+  if (!GizmoGardenSynthPlaying())
+  {
+    loadChord(chord);
+    synthSample = sampleCount = 0;
+    TCCRA |= _BV(COMB1);
+    TIMSK |= _BV(TOIE);
+  }
+  else if (chordCount < GizmoGardenSynthQueueSize)
+  {
+    chordQueue[(chordHead + chordCount) % GizmoGardenSynthQueueSize] = chord;
+    ++chordCount;
+  }
+  else
+    ok = false;
+  SREG = sreg;
+  return ok;
+}
+
+uint8_t GizmoGardenSynthQueueSpace()
+{
+  return GizmoGardenSynthQueueSize - chordCount;
+}
+
+void GizmoGardenSynthStop()
+{
+  uint8_t sreg = SREG;
+  cli();
+  silenceSynth();
+  chordCount = 0;
+  SREG = sreg;
+}
+
+uint8_t GizmoGardenSynthGetVolume(uint8_t voice)
+{
+  return voice < GizmoGardenSynthVoices ? voiceVolumes[voice] : 0;
+}
+
+void GizmoGardenSynthSetVolume(uint8_t voice, uint8_t volume)
+{
+  if (voice < GizmoGardenSynthVoices)
+    voiceVolumes[voice] = min(volume, (uint8_t)GizmoGardenSynthMaxVolume);
+}
+
+// ****************************
+// *                          *
+// *  Polyphonic Music Player  *
+// *                          *
+// ****************************
+
+GizmoGardenPolyPlayer::GizmoGardenPolyPlayer(int beatLength, bool allowMenuStartStop)
+  : GizmoGardenMusicPlayer(beatLength, allowMenuStartStop)
+{
+}
+
+uint8_t GizmoGardenPolyPlayer::soundSpace()
+{
+  return GizmoGardenSynthQueueSpace();
+}
+
+bool GizmoGardenPolyPlayer::soundPlaying()
+{
+  return GizmoGardenSynthPlaying();
+}
+
+void GizmoGardenPolyPlayer::stopSound()
+{
+  GizmoGardenSynthStop();
+}
+
+void GizmoGardenPolyPlayer::sound(const int8_t* chord, uint8_t chordSize,
+                                  uint16_t d, uint16_t duration)
+{
+  uint16_t frequencies[GizmoGardenSynthVoices];
+  uint8_t count = min(chordSize, (uint8_t)GizmoGardenSynthVoices);
+  for (uint8_t i = 0; i < count; ++i)
+    frequencies[i] = pitchFrequency(chord[i]);
+
+  if (count > 0)
+    GizmoGardenSynthQueue(frequencies, count, d);
+  if (d < duration)
+    GizmoGardenSynthQueue(0, 0, duration - d);
+}
@@ -0,0 +1,117 @@
+#ifndef _GizmoGardenSynth_
+#define _GizmoGardenSynth_
+
+/********************************************************************
+Copyright (c) 2015 Bill Silver (gizmogarden.org). This source code is
+distributed under terms of the GNU General Public License, Version 3,
+which grants certain rights to copy, modify, and redistribute. The
+license can be found at <http://www.gnu.org/licenses/>. There is no
+express or implied warranty, including merchantability or fitness for
+a particular purpose.
+********************************************************************/
+
+#include "../GizmoGarden_MusicPlayer/GizmoGardenMusicPlayer.h"
+
+// *****************
+// *               *
+// *  Synthesizer  *
+// *               *
+// *****************
+
+// A multi-voice square wave synthesizer. Timer 2 runs in Fast PWM mode at a
+// fixed sample rate, and its overflow interrupt adds up one phase accumulator
+// per voice into the PWM duty cycle. The output is the timer's OCB pin (pin 3
+// on an Uno, 9 on a Mega), which drives a piezo buzzer or a small amplifier
+// through a low-pass filter. Timer 2 is shared with GizmoGardenTone, so only
+// one of the two can be used in a sketch.
+//
+// Chords are queued the same way as GizmoGardenToneQueue, and the interrupt
+// moves from one chord to the next by itself.
+//
+// The sample rate is F_CPU / 1024, 15625 per second at 16 MHz and half that
+// at 8 MHz, where the highest pitches, above half the rate, are silent.
+//
+// Interrupt cost: every sample does the same work regardless of how many
+// voices are sounding, about 190 CPU cycles (12 us at 16 MHz) counting entry
+// and exit. Much of it is the prologue and epilogue, which save all 12
+// call-clobbered registers on every sample because the handler can call
+// loadChord. Every 16th sample also counts down the chord, and when a chord
+// ends the next is loaded, for a worst case of about 340 cycles. That is
+// about 19% of the CPU while playing, and nothing while silent. The worst
+// case is checked by the SynthBench simulator bench in extras, which counts
+// the cycles of every interrupt and fails if any run past
+// GizmoGardenSynthMaxInterruptCycles.
+//
+// The servo interrupt is held up by up to the worst case whenever a sample
+// is due just before a pulse ends. GizmoGardenServo's adaptive margin starts
+// at 25 us and can fall to 8, and only grows again after a pulse has been
+// late, so pulses would come out late by a few microseconds now and then.
+// A sketch that uses servos too should call
+//   GizmoGardenServo::setMinLatency(GizmoGardenSynthMaxInterruptTime);
+// in setup() to keep the margin above the handler's worst case. NeoPixel
+// updates hold off interrupts and will drop samples.
+
+enum
+{
+  GizmoGardenSynthVoices     = 4,
+  GizmoGardenSynthRate       = F_CPU / 1024,  // samples per second
+  GizmoGardenSynthMaxVolume  = 31,      // per voice; 4 voices fit the PWM range
+  GizmoGardenSynthQueueSize  = 4,
+
+  // Worst case interrupt time, in CPU cycles including the interrupt
+  // response, and in microseconds rounded up
+  GizmoGardenSynthMaxInterruptCycles = 350,
+  GizmoGardenSynthMaxInterruptTime   = (GizmoGardenSynthMaxInterruptCycles * 1000000L +
+                                        F_CPU - 1) / F_CPU
+};
+
+// Call this in setup() to initialize.
+void GizmoGardenSynthBegin();
+
+// Queue a chord of count frequencies, up to GizmoGardenSynthVoices, to start
+// when the previous one is done. A count of 0 queues a rest. If nothing is
+// playing, it starts immediately. Return false if the queue is full.
+bool GizmoGardenSynthQueue(const uint16_t* frequencies, uint8_t count, uint16_t duration);
+uint8_t GizmoGardenSynthQueueSpace();
+
+// Stop playing and clear the queue.
+void GizmoGardenSynthStop();
+bool GizmoGardenSynthPlaying();
+
+// Per voice volume, 0 - GizmoGardenSynthMaxVolume. It takes effect at the next chord.
+uint8_t GizmoGardenSynthGetVolume(uint8_t voice);
+void GizmoGardenSynthSetVolume(uint8_t voice, uint8_t volume);
+
+// ****************************
+// *                          *
+// *  Polyphonic Music Player  *
+// *                          *
+// ****************************
+
+// GizmoGardenPolyPlayer is a GizmoGardenMusicPlayer that plays through the
+// synthesizer, so that the chords described in GizmoGardenMusicPlayer.h
+// play all of their pitches, one per voice. Pitches beyond the number of
+// voices are ignored.
+
+class GizmoGardenPolyPlayer : public GizmoGardenMusicPlayer
+{
+public:
+  GizmoGardenPolyPlayer(int beatLength, bool allowMenuStartStop = false);
+
+protected:
+  virtual uint8_t soundSpace();
+  virtual bool soundPlaying();
+  virtual void stopSound();
+  virtual void sound(const int8_t* chord, uint8_t chordSize, uint16_t d, uint16_t duration);
+};
+
+#define MakePolyPlayer(name, beatLength)                      \
+class Class##name : public GizmoGardenPolyPlayer              \
+{                                                             \
+public:                                                       \
+  Class##name() : GizmoGardenPolyPlayer(beatLength, true) {}  \
+  CUSTOM_START                                                \
+  CUSTOM_STOP                                                 \
+} name
+
+#endif
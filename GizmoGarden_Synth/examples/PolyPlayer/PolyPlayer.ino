@@ -0,0 +1,66 @@
+// ********************************************
+// *                                          *
+// *  Gizmo Garden Polyphonic Player Example  *
+// *                                          *
+// ********************************************
+//
+// Plays "Row Row Row Your Boat" with a simple harmony, using the synthesizer
+// to sound the chords. Connect a piezo buzzer between pin 3 (pin 9 on a Mega)
+// and ground. A switch wired to ground on StopGoSwitchPin starts or stops the
+// music.
+//
+// Pitches joined by + form a chord that counts as one note. Each pitch of a
+// chord plays on its own voice of the synthesizer, up to four.
+
+#include <GizmoGardenCommon.h>
+#include <GizmoGardenMultitasking.h>
+#include <GizmoGardenTone.h>
+#include <GizmoGardenMusicPlayer.h>
+#include <GizmoGardenSynth.h>
+
+enum DigitalPins
+{
+  StopGoSwitchPin = 10,   // Switch wired to ground to start or stop the music
+};
+
+GizmoGardenPolyPlayer player(400);   // quarter note is 400 ms
+
+MakeGizmoGardenText(rowPitches, "C6+E5 C6 C6+G5 D6 E6+C6 E6+G5 D6 E6+G5 F6 G6+C6 "
+                                "C7 C7 C7 G6 G6 G6 E6 E6 E6 C6 C6 C6 "
+                                "G6+B5 F6 E6+C6 D6+B5 C6+E5+G5");
+MakeGizmoGardenText(rowTimes  , "Q Q E.S Q  E.S E.S H  T T T T T T T T T T T T  E.S E.S H");
+
+int previousStopGoSwitch = HIGH;
+
+MakeGizmoGardenTask(CheckSwitches)
+{
+  int sw = digitalRead(StopGoSwitchPin);
+  if (sw == LOW && previousStopGoSwitch == HIGH)
+  {
+    if (player.isRunning())
+      player.stop();
+    else
+      player.play(rowPitches, rowTimes);
+  }
+  previousStopGoSwitch = sw;
+
+  callMe(50);
+}
+
+void setup()
+{
+  GizmoGardenTask::begin();
+  GizmoGardenSynthBegin();
+
+  // Keep the harmony a little softer than the melody
+  for (int voice = 1; voice < GizmoGardenSynthVoices; ++voice)
+    GizmoGardenSynthSetVolume(voice, GizmoGardenSynthMaxVolume / 2);
+
+  pinMode(StopGoSwitchPin, INPUT_PULLUP);
+  CheckSwitches.start();
+}
+
+void loop()
+{
+  GizmoGardenTask::run();
+}
@@ -0,0 +1,171 @@
+/********************************************************************
+Copyright (c) 2015 Bill Silver (gizmogarden.org). This source code is
+distributed under terms of the GNU General Public License, Version 3,
+which grants certain rights to copy, modify, and redistribute. The
+license can be found at <http://www.gnu.org/licenses/>. There is no
+express or implied warranty, including merchantability or fitness for
+a particular purpose.
+********************************************************************/
+
+// ***************************************
+// *                                     *
+// *  Synthesizer Interrupt Cycle Bench  *
+// *                                     *
+// ***************************************
+
+// Runs SynthBenchFirmware in the simavr AVR simulator, instruction by
+// instruction, and counts the CPU cycles of every timer 2 overflow
+// interrupt, from the vector to the reti that turns interrupts back on.
+// The interrupt response, which the data sheet gives as 4 cycles, or 5
+// with the 3-byte program counter of a Mega, is added to each. The worst
+// case must not exceed GizmoGardenSynthMaxInterruptCycles, which the
+// firmware leaves in GPIOR1 and GPIOR2. See README.md for how to build and
+// run it.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+
+// ************
+// *          *
+// *  Boards  *
+// *          *
+// ************
+
+// Where the timer 2 overflow vector is on each chip, and the cycles it
+// takes to get there
+struct Board
+{
+  const char* name;
+  const char* mcu;
+  uint8_t overflowVector;   // vector number, 4 bytes each
+  uint8_t response;         // cycles
+};
+
+static const Board boards[] =
+{
+  { "uno",  "atmega328p",  9, 4 },
+  { "mega", "atmega2560", 15, 5 },
+};
+
+// Data space addresses of GPIOR1 and GPIOR2, the same on both chips
+enum { LimitLow = 0x4A, LimitHigh = 0x4B };
+
+// ****************
+// *              *
+// *  Statistics  *
+// *              *
+// ****************
+
+// Interrupt counts by cycles, for the report. Anything longer than this
+// is counted in the last entry.
+enum { MaxCycles = 1000 };
+static uint32_t histogram[MaxCycles + 1];
+static uint32_t interrupts;
+static uint32_t cyclesMax;
+
+// **********
+// *        *
+// *  Main  *
+// *        *
+// **********
+
+static void usage()
+{
+  printf("usage: SynthBench firmware.elf [uno | mega] [MHz]\n");
+  exit(2);
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2)
+    usage();
+
+  const Board* board = &boards[0];
+  uint32_t mhz = 16;
+  for (int i = 2; i < argc; ++i)
+  {
+    int b;
+    for (b = 0; b < (int)(sizeof(boards) / sizeof(boards[0])); ++b)
+      if (strcmp(argv[i], boards[b].name) == 0)
+        break;
+    if (b < (int)(sizeof(boards) / sizeof(boards[0])))
+      board = &boards[b];
+    else if ((mhz = (uint32_t)atoi(argv[i])) == 0)
+      usage();
+  }
+
+  elf_firmware_t firmware;
+  memset(&firmware, 0, sizeof(firmware));
+  if (elf_read_firmware(argv[1], &firmware) != 0)
+  {
+    printf("can't read %s\n", argv[1]);
+    return 2;
+  }
+
+  avr_t* avr = avr_make_mcu_by_name(board->mcu);
+  if (avr == 0)
+  {
+    printf("simavr doesn't know %s\n", board->mcu);
+    return 2;
+  }
+  avr_init(avr);
+  avr_load_firmware(avr, &firmware);
+
+  // The firmware must have been built for this clock; the sample rate and
+  // chord lengths are worked out from F_CPU at compile time
+  avr->frequency = mhz * 1000000;
+
+  printf("SynthBench: %s at %u MHz\n", board->mcu, mhz);
+
+  // simavr services an interrupt at the end of a step by pointing pc at
+  // the vector, so a step that ends there is the start of one
+  uint32_t vector = 4 * board->overflowVector;
+  bool inInterrupt = false;
+  avr_cycle_count_t start = 0;
+
+  // The firmware sleeps with interrupts off when it is done. Ten seconds
+  // of simulated time is far more than it needs.
+  avr_cycle_count_t limit = (avr_cycle_count_t)avr->frequency * 10;
+  int state = cpu_Running;
+  while (state != cpu_Done && state != cpu_Crashed && avr->cycle < limit)
+  {
+    state = avr_run(avr);
+    if (!inInterrupt && avr->pc == vector)
+    {
+      inInterrupt = true;
+      start = avr->cycle;
+    }
+    else if (inInterrupt && avr->sreg[S_I] != 0)
+    {
+      inInterrupt = false;
+      uint32_t cycles = (uint32_t)(avr->cycle - start) + board->response;
+      ++histogram[cycles < MaxCycles ? cycles : MaxCycles];
+      ++interrupts;
+      if (cycles > cyclesMax)
+        cyclesMax = cycles;
+    }
+  }
+
+  if (state == cpu_Crashed)
+    printf("firmware crashed at cycle %llu\n", (unsigned long long)avr->cycle);
+  else if (state != cpu_Done)
+    printf("firmware didn't finish in 10 s\n");
+
+  uint32_t cyclesLimit = avr->data[LimitLow] | (uint32_t)avr->data[LimitHigh] << 8;
+
+  printf("cycles  interrupts\n");
+  for (uint32_t c = 0; c <= MaxCycles; ++c)
+    if (histogram[c] != 0)
+      printf("%s%5u  %10u\n", c == MaxCycles ? ">" : " ", c, histogram[c]);
+  printf("%u interrupts, worst %u cycles (%.2f us), limit %u cycles\n",
+         interrupts, cyclesMax, (double)cyclesMax / mhz, cyclesLimit);
+
+  bool pass = state == cpu_Done && interrupts > 0 && cyclesLimit != 0 &&
+              cyclesMax <= cyclesLimit;
+  printf(pass ? "PASS\n" : "FAIL\n");
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,56 @@
+// *********************************************
+// *                                           *
+// *  Gizmo Garden Synthesizer Bench Firmware  *
+// *                                           *
+// *********************************************
+//
+// Not a sketch to run on a real Arduino. It is loaded into the simavr
+// simulator by SynthBench, which counts the cycles of every synthesizer
+// interrupt. See ../README.md.
+//
+// The sketch puts GizmoGardenSynthMaxInterruptCycles where the bench can
+// read it, in GPIOR1 and GPIOR2, which nothing else uses. Then it plays
+// rounds of the shortest chords the synthesizer can time, one block of 16
+// samples each, with every number of voices and rests among them, so that
+// a chord ends and the next is loaded as often as possible. Each round
+// ends with the queue empty, so the last chord silences the synthesizer.
+// Then the sketch turns interrupts off and sleeps, which tells simavr to
+// stop.
+
+#include <avr/sleep.h>
+
+#include <GizmoGardenCommon.h>
+#include <GizmoGardenMultitasking.h>
+#include <GizmoGardenTone.h>
+#include <GizmoGardenMusicPlayer.h>
+#include <GizmoGardenSynth.h>
+
+enum
+{
+  BenchRounds = 20,
+  BenchChords = 12      // per round, more than the queue holds
+};
+
+const uint16_t frequencies[GizmoGardenSynthVoices] = { 523, 659, 784, 1047 };
+
+void setup()
+{
+  GPIOR1 = (uint8_t)GizmoGardenSynthMaxInterruptCycles;
+  GPIOR2 = (uint8_t)(GizmoGardenSynthMaxInterruptCycles >> 8);
+
+  GizmoGardenSynthBegin();
+  for (uint8_t round = 0; round < BenchRounds; ++round)
+  {
+    for (uint8_t c = 0; c < BenchChords; ++c)
+      while (!GizmoGardenSynthQueue(frequencies, c % (GizmoGardenSynthVoices + 1), 1));
+    while (GizmoGardenSynthPlaying());
+  }
+
+  cli();
+  sleep_enable();
+  sleep_cpu();
+}
+
+void loop()
+{
+}
@@ -19,18 +19,46 @@ a particular purpose.
 #define TIMSK TIMSK2
 #define TVEC  TIMER2_COMPA_vect
 #define OCIEA OCIE2A
+#define OCRB  OCR2B
+#define COMA0 COM2A0
+#define COMA1 COM2A1
+#define COMB0 COM2B0
+#define COMB1 COM2B1
+#define FOCA  FOC2A
+#define FOCB  FOC2B
+
+// Hardware mode times durations with the compare B interrupt of timer 0,
+// which also runs millis(). It comes once per timer 0 cycle, about every
+// millisecond, whatever analogWrite has put in OCR0B.
+#define MSVEC   TIMER0_COMPB_vect
+#define MSTIMSK TIMSK0
+#define MSTIFR  TIFR0
+#define MSOCIE  OCIE0B
+#define MSOCF   OCF0B
+
+// The timer's output compare pins, for hardware mode
+#if defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+#define OCA_PIN 10
+#define OCB_PIN  9
+#else
+#define OCA_PIN 11
+#define OCB_PIN  3
+#endif
 
 int8_t pins[2];
 int8_t volume = 2;
 volatile uint8_t* pinOutputs[2];
 uint8_t pinMasks[2];
 uint32_t count;
+bool hardware;
+uint32_t endTime;       // Hardware mode only
 
 void GizmoGardenToneBegin(int pin1, int pin2)
 {
   pins[0] = pin1;
   pins[1] = pin2;
   volume = 2;
+  hardware = false;
 
   for (int i = 0; i < 2; ++i)
   {
@@ -44,16 +72,60 @@ void GizmoGardenToneBegin(int pin1, int pin2)
   TCCRA  = _BV(WGM20) | _BV(WGM21);
 }
 
+void GizmoGardenToneBeginHardware()
+{
+  GizmoGardenToneBegin(OCA_PIN, OCB_PIN);
+  hardware = true;
+
+  // CTC mode with TOP in OCRA. The outputs are disconnected, and so held
+  // low by their port bits, except while a tone plays.
+  TCCRA = _BV(WGM21);
+  TCCRB = 0;
+}
+
+bool tonePlaying()
+{
+  if (hardware)
+    return TCCRB != 0;
+  return (TIMSK & _BV(OCIEA)) != 0;
+}
+
 void stopTone()
 {
-  // Disable the timer interrupt.
+  // Disable the timer interrupt, or stop the timer, disconnect the
+  // outputs, and stop timing in hardware mode.
   TIMSK &= ~_BV(OCIEA);
+  if (hardware)
+  {
+    MSTIMSK &= ~_BV(MSOCIE);
+    TCCRB = 0;
+    TCCRA = _BV(WGM21);
+  }
 
   // Set outputs low so no stress on piezo
   for (int i = 0; i < 2; ++i)
     *pinOutputs[i] &= ~pinMasks[i];
 }
 
+bool resting;
+
+// Hardware mode: connect the compare outputs to toggle on each match, per
+// the volume. Force OCA low and OCB high first so that they toggle in
+// opposite phase, which may cut short one half cycle.
+void connectOutputs()
+{
+  uint8_t control = _BV(WGM21);
+  if (volume > 0 && !resting)
+  {
+    TCCRA = _BV(WGM21) | _BV(COMA1) | _BV(COMB1) | _BV(COMB0);
+    TCCRB |= _BV(FOCA) | _BV(FOCB);
+    control |= _BV(COMA0);
+    if (volume > 1)
+      control |= _BV(COMB0);
+  }
+  TCCRA = control;
+}
+
 int GizmoGardenGetVolume()
 {
   return volume;
@@ -62,60 +134,204 @@ int GizmoGardenGetVolume()
 void GizmoGardenSetVolume(int volume)
 {
   ::volume = (int8_t)constrain(volume, 0, 2);
+  uint8_t sreg = SREG;
+  cli();
+  if (hardware && tonePlaying())
+    connectOutputs();
+  SREG = sreg;
 }
 
+// Timer settings for one tone, computed ahead of time so that the
+// interrupt can switch tones with a few register writes.
+struct ToneSettings
+{
+  uint32_t count;   // Half cycles less 1, or milliseconds in hardware mode
+  uint8_t top;
+  uint8_t control;  // TCCRB value, plus RestFlag for a rest
+};
+
+// A rest runs the timer at this frequency just to count out its duration.
+// RestFlag uses the FOC2A bit, which must be written 0 in Fast PWM mode, so
+// it is masked off before loading TCCRB.
+enum
+{
+  RestFrequency = 1000,
+  RestFlag      = 0x80
+};
+
+ToneSettings toneQueue[GizmoGardenToneQueueSize];
+volatile uint8_t queueHead;
+volatile uint8_t queueLength;
+
 const uint8_t prescaleTable[] PROGMEM = { 0, 3, 5, 6, 7, 8, 10 };
 
-void GizmoGardenTone(uint16_t frequency, uint16_t duration)
+bool toneSettings(uint16_t frequency, uint16_t duration, ToneSettings& settings)
 {
-  stopTone();
+  uint8_t restFlag = 0;
   if (frequency == 0)
-    return;
+  {
+    frequency = RestFrequency;
+    restFlag = RestFlag;
+  }
 
   // Find smallest prescale value that can generate the frequency
-  uint8_t prescale, top;
-  for (prescale = 0; prescale < 7; ++prescale)
+  for (uint8_t prescale = 0; prescale < 7; ++prescale)
   {
     // We need interrupts at twice the frequency. Get twice the number
     // of timer ticks, then round off.
-    uint32_t ticks = (F_CPU >> pgm_read_byte(&prescaleTable[prescale])) / frequency;
+    uint8_t shift = pgm_read_byte(&prescaleTable[prescale]);
+    uint32_t ticks = (F_CPU >> shift) / frequency;
     ticks = (ticks + 1) >> 1;
     if (ticks <= 256)
     {
-      top = ticks - 1;
-      goto frequencyOK;
+      settings.top = ticks - 1;
+      settings.control = _BV(WGM22) | (prescale + 1) | restFlag; // Third bit for Fast PWM, prescale.
+
+      // The tone lasts count + 1 half cycles. Count them at the period the
+      // timer really runs at, not the one asked for, which TOP only rounds
+      // to, so that queued tones add up to their durations. Round to nearest
+      // so that the errors of queued tones don't all add up in the same
+      // direction.
+      uint32_t halfPeriod = ticks << shift;     // CPU cycles
+      uint32_t halfCycles = ((uint32_t)duration * (F_CPU / 1000) + (halfPeriod >> 1)) /
+                            halfPeriod;
+      settings.count = halfCycles > 0 ? halfCycles - 1 : 0;
+      if (hardware)
+        settings.count = duration;
+      return true;
     }
   }
-  return;
+  return false;
+}
 
-frequencyOK:
-  // Load timer registers
-  OCRA   = top;
+// Call with the timer interrupt disabled, or from the interrupt.
+void loadTone(const ToneSettings& settings)
+{
+  OCRA   = settings.top;
+  resting = (settings.control & RestFlag) != 0;
+  if (hardware)
+  {
+    // OCRA is not double buffered in CTC mode, so restart the count to
+    // keep it from running past a smaller TOP. Both outputs toggle on
+    // the same match.
+    OCRB = settings.top;
+    TCNT = 0;
+    TCCRB = settings.control & ~(RestFlag | _BV(WGM22));
+    connectOutputs();
+    endTime += settings.count;
+  }
+  else
+  {
+    TCCRB  = settings.control & ~RestFlag;
+    count  = settings.count;
+  }
+}
+
+void startTone(const ToneSettings& settings)
+{
+  endTime = millis();
+  loadTone(settings);
   TCNT = 0;
-  TCCRB  = _BV(WGM22) | (prescale + 1); // Third bit for Fast PWM, prescale.
 
-  // Compute count
-  count = (uint32_t)duration * frequency / 500;
+  // Enable the timer interrupt, or the millisecond interrupt in hardware
+  // mode.
+  if (hardware)
+  {
+    MSTIFR = _BV(MSOCF);
+    MSTIMSK |= _BV(MSOCIE);
+  }
+  else
+    TIMSK |= _BV(OCIEA);                  
+}
 
-  // Enable timer interrupt.
-  TIMSK |= _BV(OCIEA);                  
+void nextTone()
+{
+  loadTone(toneQueue[queueHead]);
+  queueHead = (queueHead + 1) % GizmoGardenToneQueueSize;
+  --queueLength;
+}
+
+void GizmoGardenTone(uint16_t frequency, uint16_t duration)
+{
+  stopTone();
+  queueLength = 0;
+  if (frequency == 0)
+    return;
+
+  ToneSettings settings;
+  if (toneSettings(frequency, duration, settings))
+    startTone(settings);
+}
+
+bool GizmoGardenToneQueue(uint16_t frequency, uint16_t duration)
+{
+  // A frequency that can't be generated is queued as a rest, so that
+  // the tones after it are still on time.
+  ToneSettings settings;
+  if (!toneSettings(frequency, duration, settings))
+    toneSettings(0, duration, settings);
+
+  bool ok = true;
+  uint8_t sreg = SREG;
+  cli();
+  if (!tonePlaying())
+    startTone(settings);
+  else if (queueLength < GizmoGardenToneQueueSize)
+  {
+    toneQueue[(queueHead + queueLength) % GizmoGardenToneQueueSize] = settings;
+    ++queueLength;
+  }
+  else
+    ok = false;
+  SREG = sreg;
+  return ok;
+}
+
+uint8_t GizmoGardenToneQueueSpace()
+{
+  return GizmoGardenToneQueueSize - queueLength;
+}
+
+bool GizmoGardenTonePlaying()
+{
+  return tonePlaying();
+}
+
+// Hardware mode only. If we're late, catch up by skipping tones, so that
+// those that follow are still on time.
+ISR(MSVEC)
+{
+  while (tonePlaying() && (int32_t)(millis() - endTime) >= 0)
+    if (queueLength == 0)
+      stopTone();
+    else
+      nextTone();
 }
 
 ISR(TVEC)
 {
   if (count-- == 0)
-    stopTone();
-  else
   {
-    uint8_t state = count & 1;
-
-    // Hopefully the compiler will unroll this loop
-    for (int i = 0; i < 2; ++i)
+    if (queueLength == 0)
     {
-      uint8_t output = *pinOutputs[i] & ~pinMasks[i];
-      if ((state ^ i ) != 0 && volume > i)
-        output |= pinMasks[i];
-      *pinOutputs[i] = output;
+      stopTone();
+      return;
     }
+
+    // This interrupt ends the old tone and is the first edge of the new
+    // one. The new TOP takes effect at the next timer BOTTOM, so at most
+    // one half cycle is off.
+    nextTone();
+  }
+
+  uint8_t state = count & 1;
+
+  // Hopefully the compiler will unroll this loop
+  for (int i = 0; i < 2; ++i)
+  {
+    uint8_t output = *pinOutputs[i] & ~pinMasks[i];
+    if ((state ^ i ) != 0 && volume > i && !resting)
+      output |= pinMasks[i];
+    *pinOutputs[i] = output;
   }
 }
@@ -15,11 +15,37 @@ a particular purpose.
 // Call this in setup() to initialize.
 void GizmoGardenToneBegin(int pin1, int pin2);
 
+// Call this in setup() instead of GizmoGardenToneBegin to use hardware mode.
+// The timer toggles its two output compare pins by itself (pins 11 and 3 on
+// an Uno, 10 and 9 on a Mega), so a tone takes no interrupts at the tone
+// frequency. Durations and the queue are then timed in milliseconds by a
+// short interrupt that piggybacks on the millis() timer, timer 0, about
+// once a millisecond while a tone plays, so nothing needs to be called
+// from loop(). Queued tones stay on time because each one ends at the
+// ideal end of the previous one plus its duration.
+void GizmoGardenToneBeginHardware();
+
 // Play a tone at the indicated frequency for the indicated duration. Any currently
 // playing tone is first stopped. If frequency is 0, stop any playing tone and
 // do nothing else.
 void GizmoGardenTone(uint16_t frequency, uint16_t duration = 0xFFFFU);
 
+// Queue a tone to start exactly when the playing tone and any tones already
+// queued are done. If nothing is playing, it starts immediately. The timer
+// interrupt moves from one tone to the next by itself, so there are no gaps
+// even if the main loop is busy. A frequency of 0 queues a rest, which is
+// timed the same way. The timer settings are computed here, not in the
+// interrupt. Return false if the queue is full. GizmoGardenTone clears the
+// queue.
+enum { GizmoGardenToneQueueSize = 4 };
+bool GizmoGardenToneQueue(uint16_t frequency, uint16_t duration);
+
+// Number of tones that can be queued now without failing.
+uint8_t GizmoGardenToneQueueSpace();
+
+// True if a tone or queued rest is playing.
+bool GizmoGardenTonePlaying();
+
 // The volume is 0 (off), 1 (half), or 2 (full). It can be changed at any time
 // and takes effect immediatly, even while a tone is playing.
 int  GizmoGardenGetVolume();